@@ -0,0 +1,47 @@
+# Turns GLSL sources into a header of constexpr strings.
+#
+# Usage: cmake -DOUTPUT=<header> -DSOURCES=<a.vert|b.frag|...> -P EmbedShaders.cmake
+# (sources are '|'-separated so the list survives add_custom_command)
+
+string(REPLACE "|" ";" SOURCES "${SOURCES}")
+
+set(body "")
+set(table "")
+foreach(src ${SOURCES})
+    get_filename_component(name "${src}" NAME)
+    string(MAKE_C_IDENTIFIER "${name}" ident)
+    file(READ "${src}" text)
+    string(APPEND body "constexpr char ${ident}[] = R\"glsl(${text})glsl\";\n\n")
+    string(APPEND table "    { \"${name}\", ${ident}, sizeof(${ident}) - 1 },\n")
+endforeach()
+
+set(content "// Generated by cmake/EmbedShaders.cmake from the GLSL sources in src/ - do not edit.
+#ifndef EMBEDDED_SHADERS_H
+#define EMBEDDED_SHADERS_H
+
+#include <cstddef>
+
+namespace embedded_shaders {
+
+struct Entry {
+    const char* name;
+    const char* source;
+    std::size_t size;
+};
+
+${body}constexpr Entry ENTRIES[] = {
+${table}};
+
+} // namespace embedded_shaders
+
+#endif
+")
+
+# Only touch the header when the content changes to avoid needless rebuilds
+if(EXISTS "${OUTPUT}")
+    file(READ "${OUTPUT}" existing)
+    if(existing STREQUAL content)
+        return()
+    endif()
+endif()
+file(WRITE "${OUTPUT}" "${content}")
@@ -0,0 +1,75 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <algorithm>
+
+// 2D orthographic camera over the grid. Grid units are cells; screen units
+// are framebuffer pixels with the origin at the top-left (GLFW convention).
+class Camera
+{
+public:
+    float centerX, centerY;   // grid position at the middle of the viewport
+    float zoom;               // framebuffer pixels per cell
+    int viewportWidth, viewportHeight;
+
+    Camera() : centerX(0), centerY(0), zoom(1), viewportWidth(1), viewportHeight(1) {}
+
+    void setViewport(int width, int height)
+    {
+        viewportWidth = std::max(1, width);
+        viewportHeight = std::max(1, height);
+    }
+
+    // show the whole world, letterboxed to keep cells square
+    void fitWorld(int worldWidth, int worldHeight)
+    {
+        centerX = worldWidth * 0.5f;
+        centerY = worldHeight * 0.5f;
+        zoom = std::min((float)viewportWidth / worldWidth, (float)viewportHeight / worldHeight);
+    }
+
+    // Column-major 3x3 grid -> NDC transform for the vertex shader
+    void viewProjection(float out[9]) const
+    {
+        float sx = 2.0f * zoom / viewportWidth;
+        float sy = 2.0f * zoom / viewportHeight;
+        out[0] = sx;    out[1] = 0.0f;  out[2] = 0.0f;
+        out[3] = 0.0f;  out[4] = sy;    out[5] = 0.0f;
+        out[6] = -centerX * sx;  out[7] = -centerY * sy;  out[8] = 1.0f;
+    }
+
+    void screenToGrid(double screenX, double screenY, float& gridX, float& gridY) const
+    {
+        gridX = centerX + (float)(screenX - viewportWidth * 0.5) / zoom;
+        gridY = centerY - (float)(screenY - viewportHeight * 0.5) / zoom;
+    }
+
+    // grid-space rectangle covered by the viewport
+    void visibleRect(float& minX, float& minY, float& maxX, float& maxY) const
+    {
+        float halfW = viewportWidth * 0.5f / zoom;
+        float halfH = viewportHeight * 0.5f / zoom;
+        minX = centerX - halfW;  maxX = centerX + halfW;
+        minY = centerY - halfH;  maxY = centerY + halfH;
+    }
+
+    // zoom by factor while keeping the cell under the cursor fixed
+    void zoomAt(double screenX, double screenY, float factor, float minZoom, float maxZoom)
+    {
+        float beforeX, beforeY, afterX, afterY;
+        screenToGrid(screenX, screenY, beforeX, beforeY);
+        zoom = std::max(minZoom, std::min(maxZoom, zoom * factor));
+        screenToGrid(screenX, screenY, afterX, afterY);
+        centerX += beforeX - afterX;
+        centerY += beforeY - afterY;
+    }
+
+    // drag by a screen-space delta (content follows the cursor)
+    void pan(double dxPixels, double dyPixels)
+    {
+        centerX -= (float)dxPixels / zoom;
+        centerY += (float)dyPixels / zoom;
+    }
+};
+
+#endif
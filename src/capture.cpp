@@ -0,0 +1,244 @@
+#include "capture.h"
+#include "image_io.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+FrameCapture::FrameCapture(int w, int h, int framesPerSecond, const std::string& t)
+    : width(w), height(h), fps(framesPerSecond > 0 ? framesPerSecond : 30),
+      format(Format::PPMSequence), target(t), isPipe(false), out(nullptr),
+      outputOk(true), finished(false), head(0), stopping(false), written(0), writeFailed(false),
+      captured(0), dropped(0), totalCaptureMs(0.0)
+{
+    if (!target.empty() && target[0] == '|') {
+        isPipe = true;
+        format = Format::Y4M;
+#ifndef _WIN32
+        // A command that exits early makes our writes fail with EPIPE
+        // rather than killing the app
+        std::signal(SIGPIPE, SIG_IGN);
+#endif
+        out = popen(target.c_str() + 1, "w");
+    } else if (target.size() > 4 && target.compare(target.size() - 4, 4, ".y4m") == 0) {
+        format = Format::Y4M;
+        out = std::fopen(target.c_str(), "wb");
+    }
+    if (format == Format::Y4M) {
+        if (!out) {
+            std::cerr << "Failed to open capture output " << target << "\n";
+            outputOk = false;
+            return;
+        }
+        // C420jpeg = full-range BT.601 with centred chroma, matches our conversion
+        std::fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+    }
+
+    size_t frameBytes = (size_t)width * height * 4;
+    glGenBuffers(RING_SIZE, pbo);
+    for (int i = 0; i < RING_SIZE; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, nullptr, GL_STREAM_READ);
+        fences[i] = nullptr;
+        readWidth[i] = readHeight[i] = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    writer = std::thread(&FrameCapture::writerLoop, this);
+}
+
+FrameCapture::~FrameCapture() {
+    finish();
+    if (outputOk)
+        glDeleteBuffers(RING_SIZE, pbo);
+}
+
+void FrameCapture::captureFrame(int framebufferWidth, int framebufferHeight) {
+    if (!ok() || finished)
+        return;
+    auto start = std::chrono::steady_clock::now();
+
+    // The slot we're about to reuse was filled RING_SIZE frames ago; hand it off first
+    collect(head);
+
+    // The top-left corner, in case the framebuffer no longer matches
+    int w = std::max(0, std::min(width, framebufferWidth));
+    int h = std::max(0, std::min(height, framebufferHeight));
+    readWidth[head] = w;
+    readHeight[head] = h;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[head]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, framebufferHeight - h, w, h, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fences[head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    head = (head + 1) % RING_SIZE;
+
+    captured++;
+    totalCaptureMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FrameCapture::collect(int slot) {
+    if (!fences[slot])
+        return;
+
+    // Normally signalled long ago; only blocks if the GPU is RING_SIZE frames behind
+    glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    glDeleteSync(fences[slot]);
+    fences[slot] = nullptr;
+
+    std::vector<uint8_t> frame;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() >= MAX_QUEUED) {
+            dropped++;
+            return;
+        }
+        if (!freeFrames.empty()) {
+            frame.swap(freeFrames.back());
+            freeFrames.pop_back();
+        }
+    }
+
+    size_t frameBytes = (size_t)width * height * 4;
+    int w = readWidth[slot], h = readHeight[slot];
+    size_t readBytes = (size_t)w * h * 4;
+    frame.resize(frameBytes);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+    void* data = readBytes ? glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readBytes, GL_MAP_READ_BIT) : nullptr;
+    if (data && readBytes == frameBytes) {
+        std::memcpy(frame.data(), data, frameBytes);
+    } else if (data) {
+        // Rows are bottom-up, so the corner's rows go to the top of the frame
+        std::fill(frame.begin(), frame.end(), 0);
+        for (int y = 0; y < h; y++)
+            std::memcpy(&frame[((size_t)(height - h + y) * width) * 4], (const uint8_t*)data + (size_t)y * w * 4,
+                        (size_t)w * 4);
+    }
+    if (data)
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!data) {
+        dropped++;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(frame));
+    }
+    cv.notify_one();
+}
+
+void FrameCapture::finish() {
+    if (finished || !outputOk)
+        return;
+    finished = true;
+
+    // Oldest first so the frame order is preserved
+    for (int i = 0; i < RING_SIZE; i++)
+        collect((head + i) % RING_SIZE);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_one();
+    if (writer.joinable())
+        writer.join();
+
+    if (out) {
+        if (isPipe) pclose(out);
+        else std::fclose(out);
+        out = nullptr;
+    }
+}
+
+// ====================== Writer Thread ======================
+void FrameCapture::writerLoop() {
+    for (;;) {
+        std::vector<uint8_t> frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+            frame.swap(queue.front());
+            queue.pop_front();
+        }
+
+        if (!writeFailed && !writeFrame(frame, written++)) {
+            std::cerr << "Capture output " << target << " stopped accepting frames, capture stopped\n";
+            writeFailed = true;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        freeFrames.push_back(std::move(frame));
+    }
+}
+
+bool FrameCapture::writeFrame(const std::vector<uint8_t>& rgba, uint64_t index) {
+    // GL rows are bottom-up; both outputs want top-down
+    if (format == Format::PPMSequence) {
+        scratch.resize((size_t)width * height * 3);
+        for (int y = 0; y < height; y++) {
+            const uint8_t* src = &rgba[(size_t)(height - 1 - y) * width * 4];
+            uint8_t* dst = &scratch[(size_t)y * width * 3];
+            for (int x = 0; x < width; x++) {
+                dst[x * 3 + 0] = src[x * 4 + 0];
+                dst[x * 3 + 1] = src[x * 4 + 1];
+                dst[x * 3 + 2] = src[x * 4 + 2];
+            }
+        }
+        std::string path = sequencePath(target, (int)index, true);
+        if (!writePPM(path, width, height, scratch.data(), false)) {
+            std::cerr << "Failed to write capture frame " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Y4M: full-range BT.601 4:2:0, chroma averaged over each 2x2 block
+    int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    scratch.resize((size_t)width * height + 2 * (size_t)cw * ch);
+    uint8_t* yPlane = scratch.data();
+    uint8_t* uPlane = yPlane + (size_t)width * height;
+    uint8_t* vPlane = uPlane + (size_t)cw * ch;
+
+    for (int y = 0; y < height; y++) {
+        const uint8_t* src = &rgba[(size_t)(height - 1 - y) * width * 4];
+        uint8_t* dst = yPlane + (size_t)y * width;
+        for (int x = 0; x < width; x++) {
+            int r = src[x * 4], g = src[x * 4 + 1], b = src[x * 4 + 2];
+            dst[x] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+        }
+    }
+    for (int cy = 0; cy < ch; cy++) {
+        for (int cx = 0; cx < cw; cx++) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for (int dy = 0; dy < 2; dy++) {
+                int y = cy * 2 + dy;
+                if (y >= height) break;
+                const uint8_t* src = &rgba[(size_t)(height - 1 - y) * width * 4];
+                for (int dx = 0; dx < 2; dx++) {
+                    int x = cx * 2 + dx;
+                    if (x >= width) break;
+                    r += src[x * 4]; g += src[x * 4 + 1]; b += src[x * 4 + 2]; n++;
+                }
+            }
+            r /= n; g /= n; b /= n;
+            int u = (-43 * r - 85 * g + 128 * b + 128 * 256 + 128) >> 8;
+            int v = (128 * r - 107 * g - 21 * b + 128 * 256 + 128) >> 8;
+            uPlane[(size_t)cy * cw + cx] = (uint8_t)(u > 255 ? 255 : u);
+            vPlane[(size_t)cy * cw + cx] = (uint8_t)(v > 255 ? 255 : v);
+        }
+    }
+
+    return std::fputs("FRAME\n", out) >= 0 && std::fwrite(scratch.data(), 1, scratch.size(), out) == scratch.size();
+}
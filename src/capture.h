@@ -0,0 +1,93 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Asynchronous frame capture.
+//
+// Each captureFrame() starts a glReadPixels into the next pixel-pack buffer
+// of a small ring and fences it. Before a slot is reused, the readback it
+// started RING_SIZE frames earlier (long finished by then) is mapped, copied
+// out and handed to a writer thread that converts and writes it.
+// The render loop therefore never waits for the GPU, only pays for one
+// memcpy of the frame.
+//
+// The target decides the output:
+//   "|command"      Y4M stream piped to command (e.g. "|ffmpeg -y -i - out.mp4")
+//   "name.y4m"      Y4M file
+//   anything else   PPM sequence, %d-style pattern for the frame number ("cap_%05d.ppm")
+//
+// The frame size is fixed when the capture starts, as a video stream needs.
+// If the framebuffer is resized later, its top-left corner is captured,
+// padded with black where it is smaller. A write that fails (the piped
+// command exited, the disk is full) stops the capture instead of the app.
+class FrameCapture
+{
+public:
+    FrameCapture(int width, int height, int fps, const std::string& target);
+    ~FrameCapture();
+
+    // False once the output couldn't be opened or a write to it failed
+    bool ok() const { return outputOk && !writeFailed; }
+
+    // Queue a readback of the currently bound read framebuffer, which is
+    // framebufferWidth x framebufferHeight.
+    void captureFrame(int framebufferWidth, int framebufferHeight);
+
+    // Drain the ring and the writer queue, then close the output.
+    void finish();
+
+    uint64_t framesCaptured() const { return captured; }
+    uint64_t framesDropped() const { return dropped; }
+    double averageCaptureMs() const { return captured ? totalCaptureMs / captured : 0.0; }
+
+private:
+    static const int RING_SIZE = 3;
+    static const size_t MAX_QUEUED = 8;   // frames; beyond this the writer is too slow and we drop
+
+    enum class Format { Y4M, PPMSequence };
+
+    void collect(int slot);
+    void writerLoop();
+    bool writeFrame(const std::vector<uint8_t>& rgba, uint64_t index);
+
+    int width, height, fps;
+    Format format;
+    std::string target;
+    bool isPipe;
+    FILE* out;
+    bool outputOk;
+    bool finished;
+
+    // GL side (render thread only)
+    unsigned int pbo[RING_SIZE];
+    GLsync fences[RING_SIZE];
+    int readWidth[RING_SIZE], readHeight[RING_SIZE];   // part of the frame each slot holds
+    int head;
+
+    // writer side
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t>> queue;
+    std::vector<std::vector<uint8_t>> freeFrames;
+    bool stopping;
+    std::vector<uint8_t> scratch;   // converted frame, writer thread only
+    uint64_t written;
+    std::atomic<bool> writeFailed;
+
+    uint64_t captured, dropped;
+    double totalCaptureMs;
+};
+
+#endif
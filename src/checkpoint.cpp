@@ -0,0 +1,249 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+// ====================== World Capture ======================
+// Copying every changed chunk at one tick boundary would stall that tick in
+// proportion to the active region, so chunks are copied a few per tick
+// ahead of time instead, oldest first, and copied again if they change
+// after that. At the first tick boundary with few enough chunks left (or
+// on the deadline) the checkpoint fixes its tick: the header, particles and
+// random state are taken there, and the chunks still left are kept as they
+// are at that tick copy-on-write: their cell planes and heat region are
+// each copied right before they first change (touchChunk) or by the
+// budget, whichever comes first. The capture is handed back once the last
+// of them is in.
+void World::beginCheckpoint(std::unique_ptr<CheckpointCapture> capture, bool everything) {
+    capture->width = gridWidth;
+    capture->height = gridHeight;
+    capture->everything = everything;
+    capture->chunks.clear();
+    capture->blank.clear();
+    capture->slots.clear();
+    capture->dataUsed = 0;
+    capture->frozenChunks = 0;
+    capture->copiedOnWrite = 0;
+
+    // Only mark here, which costs a pass over one byte per chunk
+    pendingChunks.clear();
+    for (size_t c = 0; c < checkpointDirty.size(); c++) {
+        if (checkpointDirty[c] || everything) {
+            capturePending[c] = CAPTURE_ALL;
+            pendingChunks.push_back((uint32_t)c);
+        }
+    }
+    checkpointDeadline = tickCount + pendingChunks.size() / CHECKPOINT_CHUNKS_PER_TICK + CHECKPOINT_SETTLE_TICKS;
+    checkpointFrozen = false;
+    checkpoint = std::move(capture);
+}
+
+// Copy parts of chunk into its entry. A whole copy also tells whether the
+// chunk is blank, so blank chunks take no buffer; one part alone (only
+// after the tick is fixed) is stored as it is and left to the writer to
+// check.
+void World::captureChunk(size_t chunk, uint8_t parts) {
+    capturePending[chunk] &= (uint8_t)~parts;
+    if (!checkpointFrozen)
+        checkpointDirty[chunk] = 0;
+    CheckpointCapture& capture = *checkpoint;
+    int32_t entry = captureEntry[chunk];
+    if (entry < 0) {
+        entry = (int32_t)capture.chunks.size();
+        captureEntry[chunk] = entry;
+        capture.chunks.push_back((uint32_t)chunk);
+        capture.blank.push_back(1);
+        capture.slots.push_back(UINT32_MAX);
+    }
+    // A chunk gets a buffer the first time it isn't blank and keeps it
+    uint32_t& slot = capture.slots[entry];
+    bool fresh = slot == UINT32_MAX;
+    if (fresh) {
+        if (capture.dataUsed == capture.data.size())
+            capture.data.emplace_back(pagedChunkBytes(CHUNK_SIZE, HEAT_SCALE));
+        slot = (uint32_t)capture.dataUsed++;
+    }
+    uint8_t* out = capture.data[slot].data();
+    if (parts != CAPTURE_ALL) {
+        const int hs = CHUNK_SIZE / HEAT_SCALE;
+        const size_t planeBytes = 3 * (size_t)CHUNK_CELLS;
+        if (parts & CAPTURE_CELLS)
+            std::memcpy(out, chunkData(chunk), planeBytes);
+        if (parts & CAPTURE_HEAT)
+            std::memcpy(out + planeBytes, heat.region(chunk), hs * hs * sizeof(float));
+        capture.blank[entry] = 0;
+        return;
+    }
+    bool stored = copyChunk(chunk, out);
+    capture.blank[entry] = !stored;
+    if (!stored && fresh) {
+        capture.dataUsed--;
+        slot = UINT32_MAX;
+    }
+}
+
+void World::copyBeforeChange(size_t chunk, uint8_t parts) {
+    auto start = std::chrono::steady_clock::now();
+    captureChunk(chunk, parts);
+    checkpoint->copiedOnWrite++;
+    checkpointCopyNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t World::takeCheckpointCopyNs() {
+    uint64_t ns = checkpointCopyNs;
+    checkpointCopyNs = 0;
+    return ns;
+}
+
+std::unique_ptr<CheckpointCapture> World::continueCheckpoint(int chunkBudget) {
+    if (!checkpoint)
+        return nullptr;
+    if (!checkpointFrozen) {
+        for (; !pendingChunks.empty() && chunkBudget > 0; chunkBudget--) {
+            captureChunk(pendingChunks.front(), CAPTURE_ALL);
+            pendingChunks.pop_front();
+        }
+        if (pendingChunks.size() > (size_t)CHECKPOINT_FINAL_CHUNKS && tickCount < checkpointDeadline)
+            return nullptr;
+
+        // Fix the checkpoint at this tick boundary; from here on touchChunk
+        // copies the parts of a pending chunk about to change and queues
+        // nothing new. The copies to come are of this tick, so the chunks
+        // are clean unless they change after it.
+        checkpoint->frozenChunks = pendingChunks.size();
+        for (uint32_t c : pendingChunks)
+            checkpointDirty[c] = 0;
+        pagedState(checkpoint->header, checkpoint->chunkInfo, checkpoint->extra);
+        checkpointFrozen = true;
+    }
+
+    // Entries already copied on write are dropped without using the budget
+    while (!pendingChunks.empty()) {
+        uint32_t c = pendingChunks.front();
+        if (capturePending[c]) {
+            if (chunkBudget <= 0)
+                return nullptr;
+            captureChunk(c, capturePending[c]);
+            chunkBudget--;
+        }
+        pendingChunks.pop_front();
+    }
+    checkpointFrozen = false;
+    for (uint32_t c : checkpoint->chunks)
+        captureEntry[c] = -1;
+    return std::move(checkpoint);
+}
+
+// ====================== Checkpointer ======================
+Checkpointer::Checkpointer(const std::string& p, int intervalTicks)
+    : path(p), interval(std::max(1, intervalTicks)), lastStart(0), started(false),
+      writing(false), stopping(false), rewriteAll(false)
+{
+    worker = std::thread(&Checkpointer::run, this);
+}
+
+Checkpointer::~Checkpointer() {
+    stop();
+}
+
+void Checkpointer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    if (worker.joinable())
+        worker.join();
+}
+
+void Checkpointer::afterTick(World& world) {
+    auto start = std::chrono::steady_clock::now();
+
+    if (!world.capturingCheckpoint() && (!started || world.tick() - lastStart >= (uint64_t)interval)) {
+        // The previous checkpoint is still on its way to disk: try again
+        // next tick rather than queue up captures
+        std::unique_ptr<CheckpointCapture> capture;
+        bool everything = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queued || writing || stopping)
+                return;
+            capture = spare ? std::move(spare) : std::unique_ptr<CheckpointCapture>(new CheckpointCapture());
+            everything = rewriteAll;
+            rewriteAll = false;
+        }
+        world.beginCheckpoint(std::move(capture), everything);
+        lastStart = world.tick();
+        started = true;
+    }
+
+    std::unique_ptr<CheckpointCapture> done = world.continueCheckpoint(CHECKPOINT_CHUNKS_PER_TICK);
+
+    // The copying here plus what the tick just run copied on write, taken
+    // before waking the writer, which on a single core may run first
+    uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count() + world.takeCheckpointCopyNs() / 1000;
+    if (us > maxStallUs.load(std::memory_order_relaxed))
+        maxStallUs.store(us, std::memory_order_relaxed);
+
+    if (done) {
+        if (done->frozenChunks > (size_t)CHECKPOINT_FINAL_CHUNKS)
+            lateCheckpoints.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued = std::move(done);
+        }
+        wake.notify_one();
+    }
+}
+
+void Checkpointer::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&] { return queued || stopping; });
+        if (!queued)
+            return;
+        std::unique_ptr<CheckpointCapture> capture = std::move(queued);
+        writing = true;
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = write(*capture);
+        writeUs.store((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+        if (ok)
+            checkpoints.fetch_add(1, std::memory_order_relaxed);
+        else
+            std::cerr << "Checkpoint to " << path << " failed, retrying with the whole world\n";
+
+        lock.lock();
+        writing = false;
+        rewriteAll = rewriteAll || !ok;
+        spare = std::move(capture);
+    }
+}
+
+bool Checkpointer::write(const CheckpointCapture& capture) {
+    // A new file for the first checkpoint, after a failure, or once the
+    // world was replaced by one of another size; those captures cover every
+    // chunk that differs from an empty world. The new file only replaces
+    // the last good one once its first update is complete.
+    if (!writer.isOpenFor(capture.width, capture.height) || capture.everything) {
+        if (!writer.create(path, capture.width, capture.height, CHUNK_SIZE, HEAT_SCALE))
+            return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < capture.chunks.size() && ok; i++) {
+        // Parts copied on write weren't checked for blank when taken
+        const uint8_t* data = capture.blank[i] ? nullptr : capture.data[capture.slots[i]].data();
+        ok = writer.writeChunk(capture.chunks[i], data && !World::blankChunk(data) ? data : nullptr);
+    }
+    ok = ok && writer.finish(capture.header, capture.chunkInfo.data(), capture.extra);
+    if (!ok)
+        writer.close();
+    chunks.fetch_add(capture.chunks.size(), std::memory_order_relaxed);
+    return ok;
+}
@@ -0,0 +1,74 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "paged_world.h"
+#include "simulation.h"
+
+// ====================== Checkpoints ======================
+// Periodic autosave to a paged world file (paged_world.h) for long runs.
+// Every interval ticks the world starts a capture (World::beginCheckpoint)
+// of the chunks changed since the previous checkpoint, copied a few per
+// tick until it can fix a consistent view of one tick boundary and keep the
+// rest of them copy-on-write. Once it is complete, a writer thread updates
+// the file in place with just those chunks, so the simulation thread never
+// waits for the disk and its per-tick cost is CHECKPOINT_CHUNKS_PER_TICK
+// copies plus one for each still-pending chunk the tick changes: at most
+// CHECKPOINT_FINAL_CHUNKS unless the view was fixed on its deadline, and
+// fewer every tick after.
+class Checkpointer
+{
+public:
+    Checkpointer(const std::string& path, int intervalTicks);
+    ~Checkpointer();
+
+    // Finish the checkpoint being written and stop the writer thread; later
+    // captures are dropped. Called by the destructor.
+    void stop();
+
+    // Simulation thread, after every tick. The stall it measures is its own
+    // copying plus the copies the tick made on write, the whole cost.
+    void afterTick(World& world);
+
+    uint64_t written() const { return checkpoints.load(std::memory_order_relaxed); }
+    uint64_t chunksWritten() const { return chunks.load(std::memory_order_relaxed); }
+    double longestStallMs() const { return maxStallUs.load(std::memory_order_relaxed) / 1000.0; }
+    double lastWriteMs() const { return writeUs.load(std::memory_order_relaxed) / 1000.0; }
+    // Checkpoints that fixed their tick on the deadline with more than
+    // CHECKPOINT_FINAL_CHUNKS chunks still to copy
+    uint64_t overBound() const { return lateCheckpoints.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    bool write(const CheckpointCapture& capture);
+
+    std::string path;
+    int interval;
+    uint64_t lastStart;             // tick the last capture began (simulation thread)
+    bool started;
+
+    PagedWorldWriter writer;        // writer thread only
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::unique_ptr<CheckpointCapture> queued;  // complete capture waiting for the writer
+    std::unique_ptr<CheckpointCapture> spare;   // written capture, reused by the next one
+    bool writing;
+    bool stopping;
+    bool rewriteAll;                // last write failed: the next capture takes every chunk
+
+    std::atomic<uint64_t> checkpoints{0};
+    std::atomic<uint64_t> chunks{0};
+    std::atomic<uint64_t> maxStallUs{0};
+    std::atomic<uint64_t> writeUs{0};
+    std::atomic<uint64_t> lateCheckpoints{0};
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "engine.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+uint32_t detectCpuFeatures() {
+    static const uint32_t features = [] {
+        uint32_t f = 0;
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2"))   f |= CPU_SSE2;
+        if (__builtin_cpu_supports("sse4.1")) f |= CPU_SSE41;
+        if (__builtin_cpu_supports("avx2"))   f |= CPU_AVX2;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        int info[4];
+        __cpuid(info, 1);
+        if (info[3] & (1 << 26)) f |= CPU_SSE2;
+        if (info[2] & (1 << 19)) f |= CPU_SSE41;
+        // AVX2 also needs the OS to save the YMM registers
+        bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+        __cpuid(info, 0);
+        if (osSavesYmm && info[0] >= 7) {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5)) f |= CPU_AVX2;
+        }
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+        f |= CPU_NEON;
+#endif
+        return f;
+    }();
+    return features;
+}
+
+std::string cpuFeatureNames(uint32_t features) {
+    static const struct { CpuFeature bit; const char* name; } names[] = {
+        { CPU_SSE2, "sse2" }, { CPU_SSE41, "sse4.1" }, { CPU_AVX2, "avx2" }, { CPU_NEON, "neon" }
+    };
+    std::string result;
+    for (const auto& n : names) {
+        if (!(features & n.bit)) continue;
+        if (!result.empty()) result += ' ';
+        result += n.name;
+    }
+    return result.empty() ? "none" : result;
+}
+
+// ====================== Registry ======================
+EngineRegistry& EngineRegistry::instance() {
+    static EngineRegistry registry = [] {
+        EngineRegistry r;
+        r.add({ "particles", "particles", "scalar reference: particles with velocity, sliding and density",
+                0, 0, &createParticleEngine });
+        r.add({ "margolus", "margolus", "2x2 block automaton from a lookup table, deterministic",
+                0, 0, &createMargolusEngine });
+        return r;
+    }();
+    return registry;
+}
+
+void EngineRegistry::add(const EngineInfo& info) {
+    entries.push_back(info);
+}
+
+const EngineInfo* EngineRegistry::find(const std::string& name) const {
+    for (const auto& e : entries)
+        if (name == e.name)
+            return &e;
+    return nullptr;
+}
+
+const EngineInfo* EngineRegistry::best(const std::string& family, uint32_t cpuFeatures) const {
+    const EngineInfo* best = nullptr;
+    for (const auto& e : entries) {
+        if (family != e.family || (e.requiredCpu & ~cpuFeatures) != 0)
+            continue;
+        if (!best || e.priority > best->priority)
+            best = &e;
+    }
+    return best;
+}
+
+std::unique_ptr<SimulationEngine> EngineRegistry::create(const std::string& name) const {
+    uint32_t cpu = detectCpuFeatures();
+    const EngineInfo* info = name == "auto" ? best(DEFAULT_ENGINE_FAMILY, cpu) : find(name);
+    if (!info || (info->requiredCpu & ~cpu) != 0)
+        return nullptr;
+    return info->create();
+}
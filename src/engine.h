@@ -0,0 +1,95 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class World;
+
+// ====================== Simulation Engines ======================
+// An engine decides how cells move each tick. Everything else in a tick
+// (lifetimes, heat, reactions of burning cells) is the World's and runs the
+// same whichever engine is plugged in.
+
+// What an engine does, so the world and the UI can adapt to it
+enum EngineCapability : uint32_t {
+    ENGINE_PARTICLES = 1 << 0,      // moving cells live in the particle list; without it every cell rests in the grid
+    ENGINE_VELOCITY = 1 << 1,       // falling cells accelerate
+    ENGINE_GASES = 1 << 2,          // gases rise
+    ENGINE_DENSITY = 1 << 3,        // heavier materials sink through lighter ones
+    ENGINE_DETERMINISTIC = 1 << 4   // no random choices, independent of update order
+};
+
+// Instruction set extensions an engine may require
+enum CpuFeature : uint32_t {
+    CPU_SSE2 = 1 << 0,
+    CPU_SSE41 = 1 << 1,
+    CPU_AVX2 = 1 << 2,
+    CPU_NEON = 1 << 3
+};
+
+// Features of the CPU we're running on (detected once)
+uint32_t detectCpuFeatures();
+
+// Space separated names of the given features ("sse2 avx2"), "none" if empty
+std::string cpuFeatureNames(uint32_t features);
+
+class SimulationEngine
+{
+public:
+    virtual ~SimulationEngine() = default;
+
+    virtual const char* name() const = 0;
+    virtual uint32_t capabilities() const = 0;
+
+    // Move the world's cells for tick number tick
+    virtual void step(World& world, uint64_t tick) = 0;
+};
+
+// One registered implementation. Engines sharing a family implement the
+// same behaviour (e.g. a SIMD kernel of the reference rules); auto-selection
+// picks the highest priority one of the default family the CPU can run.
+struct EngineInfo {
+    const char* name;
+    const char* family;
+    const char* description;
+    uint32_t requiredCpu;           // CpuFeature bits
+    int priority;
+    std::unique_ptr<SimulationEngine> (*create)();
+};
+
+class EngineRegistry
+{
+public:
+    // The registry with every built-in engine
+    static EngineRegistry& instance();
+
+    void add(const EngineInfo& info);
+
+    const std::vector<EngineInfo>& engines() const { return entries; }
+
+    // nullptr if there is no engine with that name
+    const EngineInfo* find(const std::string& name) const;
+
+    // Fastest engine of family that runs with cpuFeatures
+    const EngineInfo* best(const std::string& family, uint32_t cpuFeatures) const;
+
+    // "auto" picks best(DEFAULT_ENGINE_FAMILY, detected CPU), anything else
+    // is looked up by name. nullptr if unknown or not supported by this CPU.
+    std::unique_ptr<SimulationEngine> create(const std::string& name) const;
+
+private:
+    std::vector<EngineInfo> entries;
+};
+
+const char* const DEFAULT_ENGINE_FAMILY = "particles";
+
+// ------------------- Built-in Engines -------------------
+// Scalar reference: particles with velocity, sliding, dispersion and density
+std::unique_ptr<SimulationEngine> createParticleEngine();
+// 2x2 Margolus block automaton (margolus.h)
+std::unique_ptr<SimulationEngine> createMargolusEngine();
+
+#endif
@@ -0,0 +1,133 @@
+#include "headless.h"
+
+#ifdef SAND_HAVE_EGL
+
+#include <EGL/eglext.h>
+
+#include <cstring>
+#include <iostream>
+
+// ====================== Headless Context ======================
+HeadlessContext::HeadlessContext()
+    : display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT) {}
+
+HeadlessContext::~HeadlessContext() {
+    destroy();
+}
+
+static bool hasExtension(const char* list, const char* name) {
+    if (!list) return false;
+    size_t len = std::strlen(name);
+    for (const char* p = list; (p = std::strstr(p, name)) != nullptr; p += len) {
+        if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+            return true;
+    }
+    return false;
+}
+
+bool HeadlessContext::create() {
+    // Prefer the surfaceless platform so no X11/Wayland/GBM device is needed
+    const char* clientExts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (hasExtension(clientExts, "EGL_MESA_platform_surfaceless")) {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        std::cerr << "Failed to initialize EGL display\n";
+        display = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    const char* displayExts = eglQueryString(display, EGL_EXTENSIONS);
+    if (!hasExtension(displayExts, "EGL_KHR_surfaceless_context")) {
+        std::cerr << "EGL display lacks EGL_KHR_surfaceless_context\n";
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL cannot bind the desktop OpenGL API\n";
+        return false;
+    }
+
+    // Any GL-capable config will do since we never create a surface
+    EGLConfig config = nullptr;
+    if (!hasExtension(displayExts, "EGL_KHR_no_config_context")) {
+        const EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+            std::cerr << "No EGL config supports desktop OpenGL\n";
+            return false;
+        }
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        std::cerr << "Failed to create EGL OpenGL 3.3 core context (0x" << std::hex << eglGetError() << std::dec << ")\n";
+        return false;
+    }
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cerr << "Failed to make EGL context current\n";
+        return false;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        std::cerr << "Failed to initialize GLAD\n";
+        return false;
+    }
+    return true;
+}
+
+void HeadlessContext::destroy() {
+    if (display == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context != EGL_NO_CONTEXT)
+        eglDestroyContext(display, context);
+    eglTerminate(display);
+    context = EGL_NO_CONTEXT;
+    display = EGL_NO_DISPLAY;
+}
+
+// ====================== Offscreen Target ======================
+OffscreenTarget::OffscreenTarget(int w, int h)
+    : width(w), height(h), FBO(0), colorRBO(0)
+{
+    glGenFramebuffers(1, &FBO);
+    glGenRenderbuffers(1, &colorRBO);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "ERROR::FRAMEBUFFER:: Offscreen framebuffer is not complete\n";
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+OffscreenTarget::~OffscreenTarget() {
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteRenderbuffers(1, &colorRBO);
+}
+
+void OffscreenTarget::bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glViewport(0, 0, width, height);
+}
+
+void OffscreenTarget::readPixels(std::vector<unsigned char>& rgb) const {
+    rgb.resize((size_t)width * height * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, rgb.data());
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// Offscreen rendering without a window system. Only built when CMake found
+// EGL (SAND_HAVE_EGL); the windowed GLFW path does not depend on it.
+#ifdef SAND_HAVE_EGL
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+
+#include <vector>
+
+// OpenGL 3.3 core context on the EGL surfaceless platform (Mesa, including
+// llvmpipe on CPU-only machines). Nothing is ever presented; render into an
+// OffscreenTarget instead.
+class HeadlessContext
+{
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    // Create the context, make it current and load GL entry points.
+    // Prints the reason and returns false on failure.
+    bool create();
+    void destroy();
+
+private:
+    EGLDisplay display;
+    EGLContext context;
+};
+
+// Framebuffer object with a single RGBA8 colour attachment.
+class OffscreenTarget
+{
+public:
+    OffscreenTarget(int width, int height);
+    ~OffscreenTarget();
+
+    // bind as the draw framebuffer and set the viewport to cover it
+    void bind() const;
+
+    // synchronous read of the colour attachment as RGB, bottom-up rows
+    void readPixels(std::vector<unsigned char>& rgb) const;
+
+    int width, height;
+    unsigned int FBO, colorRBO;
+};
+
+#endif
+#endif
@@ -0,0 +1,174 @@
+#include "heat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Regions round up to a power of two side, so finding one takes a shift
+static int log2Ceil(int size) {
+    int shift = 0;
+    while ((1 << shift) < size)
+        shift++;
+    return shift;
+}
+
+HeatField::HeatField(int width, int height, int size, float threshold)
+    : fieldWidth(std::max(1, width)), fieldHeight(std::max(1, height)),
+      regionSize(1 << log2Ceil(size)), regionShift(log2Ceil(size)), regionMask(regionSize - 1),
+      regionsX((fieldWidth + regionSize - 1) / regionSize),
+      regionsY((fieldHeight + regionSize - 1) / regionSize),
+      hotThreshold(threshold),
+      owned((size_t)regionsX * regionsY),
+      ambient((size_t)regionSize * regionSize, AMBIENT_TEMPERATURE),
+      tile((size_t)(regionSize + 2) * (regionSize + 2)),
+      awake(owned.size(), 0),
+      hot(owned.size(), 0),
+      changed(owned.size(), 0)
+{
+    regions.assign(owned.size(), ambient.data());
+    active.reserve(owned.size());
+}
+
+// Region r's own copy of its values, made on its first change
+float* HeatField::ownRegion(size_t r) {
+    if (!owned[r]) {
+        size_t count = (size_t)regionSize * regionSize;
+        owned[r].reset(new float[count]);
+        std::memcpy(owned[r].get(), regions[r], count * sizeof(float));
+        regions[r] = owned[r].get();
+    }
+    return owned[r].get();
+}
+
+void HeatField::raise(int x, int y, float t) {
+    if (t <= at(x, y) + HEAT_EPSILON)
+        return;
+    size_t r = regionOf(x, y);
+    ownRegion(r)[(size_t)(y & regionMask) << regionShift | (x & regionMask)] = t;
+    awake[r] = 1;
+    if (t > hotThreshold)
+        hot[r] = 1;
+}
+
+void HeatField::readRow(int y, float* out) const {
+    size_t ry = (size_t)(y / regionSize) * regionsX, offset = (size_t)(y % regionSize) * regionSize;
+    for (int rx = 0, x0 = 0; rx < regionsX; rx++, x0 += regionSize)
+        std::memcpy(out + x0, regions[ry + rx] + offset, (size_t)std::min(regionSize, fieldWidth - x0) * sizeof(float));
+}
+
+void HeatField::writeRow(int y, const float* values) {
+    size_t ry = (size_t)(y / regionSize) * regionsX, offset = (size_t)(y % regionSize) * regionSize;
+    for (int rx = 0, x0 = 0; rx < regionsX; rx++, x0 += regionSize) {
+        size_t bytes = (size_t)std::min(regionSize, fieldWidth - x0) * sizeof(float);
+        if (std::memcmp(regions[ry + rx] + offset, values + x0, bytes) != 0)
+            std::memcpy(ownRegion(ry + rx) + offset, values + x0, bytes);
+    }
+}
+
+// Stencil over one row of a region. Plain loops over floats, so the
+// compiler vectorizes them; the reductions are integer ORs, which (unlike a
+// float max) vectorize without fast-math.
+static void diffuseRow(const float* up, const float* row, const float* down, float* out, int count,
+                       float hotThreshold, int& changed, int& hot) {
+    int anyChanged = 0, anyHot = 0;
+    for (int i = 0; i < count; i++) {
+        float c = row[i];
+        float laplacian = row[i - 1] + row[i + 1] + up[i] + down[i] - 4.0f * c;
+        float v = c + HEAT_DIFFUSION * laplacian - HEAT_COOLING * (c - AMBIENT_TEMPERATURE);
+        out[i] = v;
+        anyChanged |= std::fabs(v - c) > HEAT_EPSILON;
+        anyHot |= v > hotThreshold;
+    }
+    changed |= anyChanged;
+    hot |= anyHot;
+}
+
+void HeatField::step() {
+    active.clear();
+    for (size_t r = 0; r < awake.size(); r++)
+        if (awake[r])
+            active.push_back((uint32_t)r);
+
+    // Jacobi step: awake regions read the current values and write next,
+    // then copy back, so neighbouring regions see each other's old values
+    // whatever the order. Each region is stepped in a tile holding it and
+    // the rows and columns of its neighbours next to it (ambient past the
+    // field's edge, like the part of a region past it).
+    const size_t count = (size_t)regionSize * regionSize;
+    const int side = regionSize + 2;
+    next.resize(active.size() * count);
+    for (size_t k = 0; k < active.size(); k++) {
+        uint32_t r = active[k];
+        int rx = (int)(r % regionsX), ry = (int)(r / regionsX);
+        int w = std::min(regionSize, fieldWidth - rx * regionSize), h = std::min(regionSize, fieldHeight - ry * regionSize);
+        const float* left = rx > 0 ? regions[r - 1] : nullptr;
+        const float* right = rx + 1 < regionsX ? regions[r + 1] : nullptr;
+        const float* below = ry > 0 ? regions[r - regionsX] : nullptr;
+        const float* above = ry + 1 < regionsY ? regions[r + regionsX] : nullptr;
+        std::fill(tile.begin(), tile.end(), AMBIENT_TEMPERATURE);
+        for (int y = 0; y < regionSize; y++) {
+            float* row = &tile[(size_t)(y + 1) * side];
+            std::memcpy(row + 1, regions[r] + (size_t)y * regionSize, regionSize * sizeof(float));
+            if (left)
+                row[0] = left[(size_t)y * regionSize + regionSize - 1];
+            if (right)
+                row[regionSize + 1] = right[(size_t)y * regionSize];
+        }
+        if (below)
+            std::memcpy(&tile[1], below + (size_t)(regionSize - 1) * regionSize, regionSize * sizeof(float));
+        if (above)
+            std::memcpy(&tile[(size_t)(regionSize + 1) * side + 1], above, regionSize * sizeof(float));
+
+        float* out = &next[k * count];
+        std::memcpy(out, regions[r], count * sizeof(float));
+        int anyChanged = 0, anyHot = 0;
+        for (int y = 0; y < h; y++) {
+            const float* row = &tile[(size_t)(y + 1) * side + 1];
+            diffuseRow(row - side, row, row + side, out + (size_t)y * regionSize, w, hotThreshold, anyChanged, anyHot);
+        }
+        changed[r] = (uint8_t)anyChanged;
+        hot[r] = (uint8_t)anyHot;
+    }
+    for (size_t k = 0; k < active.size(); k++) {
+        uint32_t r = active[k];
+        const float* values = &next[k * count];
+        if (std::memcmp(values, regions[r], count * sizeof(float)) != 0)
+            std::memcpy(ownRegion(r), values, count * sizeof(float));
+    }
+
+    for (uint32_t r : active)
+        awake[r] = changed[r];
+    for (uint32_t r : active)
+        if (changed[r])
+            wakeNeighbours((int)(r % regionsX), (int)(r / regionsX));
+}
+
+// Wake each neighbour of region (rx, ry) whose shared border has a
+// temperature step above HEAT_GRADIENT
+void HeatField::wakeNeighbours(int rx, int ry) {
+    int x0 = rx * regionSize, y0 = ry * regionSize;
+    int x1 = std::min(x0 + regionSize, fieldWidth), y1 = std::min(y0 + regionSize, fieldHeight);
+
+    auto columnStep = [&](int xa, int xb) {
+        for (int y = y0; y < y1; y++)
+            if (std::fabs(at(xa, y) - at(xb, y)) > HEAT_GRADIENT)
+                return true;
+        return false;
+    };
+    auto rowStep = [&](int ya, int yb) {
+        for (int x = x0; x < x1; x++)
+            if (std::fabs(at(x, ya) - at(x, yb)) > HEAT_GRADIENT)
+                return true;
+        return false;
+    };
+
+    size_t r = (size_t)ry * regionsX + rx;
+    if (rx > 0 && columnStep(x0, x0 - 1))
+        awake[r - 1] = 1;
+    if (rx + 1 < regionsX && columnStep(x1 - 1, x1))
+        awake[r + 1] = 1;
+    if (ry > 0 && rowStep(y0, y0 - 1))
+        awake[r - regionsX] = 1;
+    if (ry + 1 < regionsY && rowStep(y1 - 1, y1))
+        awake[r + regionsX] = 1;
+}
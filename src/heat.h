@@ -0,0 +1,86 @@
+#ifndef HEAT_H
+#define HEAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// ====================== Heat Field ======================
+// Temperature on a coarse grid (one value per few world cells), diffused
+// with an explicit 5-point stencil and slowly cooling towards ambient.
+//
+// The field is split into square regions. Only awake regions are stepped;
+// a region falls asleep once a step changes none of its values by more than
+// HEAT_EPSILON, and is woken by a heat source or by a neighbour whose border
+// differs from it by more than HEAT_GRADIENT. A world at rest, cold or with
+// steady sources, costs one flag check per region.
+//
+// Each region's values are a block of their own. A region at ambient shares
+// one block with all the others, and a region can read its block from
+// outside (a mapped world file) until it first changes; only regions that
+// have changed hold memory.
+const float AMBIENT_TEMPERATURE = 20.0f;
+const float HEAT_DIFFUSION = 0.2f;    // per step, below 0.25 for stability
+const float HEAT_COOLING = 0.01f;     // fraction of the excess over ambient lost per step
+const float HEAT_EPSILON = 0.05f;     // largest change per step that counts as settled
+const float HEAT_GRADIENT = 1.0f;     // border difference that wakes a neighbour region
+
+class HeatField
+{
+public:
+    // width x height coarse cells, regions of regionSize x regionSize
+    // (a power of two). A region counts as hot while any of its values
+    // exceeds hotThreshold.
+    HeatField(int width, int height, int regionSize, float hotThreshold);
+
+    int width() const { return fieldWidth; }
+    int height() const { return fieldHeight; }
+
+    float at(int x, int y) const {
+        return regions[regionOf(x, y)][(size_t)(y & regionMask) << regionShift | (x & regionMask)];
+    }
+
+    // Heat source: hold (x, y) at least at t
+    void raise(int x, int y, float t);
+
+    // One diffusion step over the awake regions
+    void step();
+
+    // Row y of the field (width() values), for saving and loading;
+    // writeRow only takes a copy of the regions whose values it changes
+    void readRow(int y, float* out) const;
+    void writeRow(int y, const float* values);
+
+    // Region r's regionSize x regionSize values, row-major; the part past
+    // the field's edge is ambient
+    const float* region(size_t r) const { return regions[r]; }
+
+    // Read region r from values kept elsewhere, laid out like region(),
+    // until it first changes. They must outlive the field or that change.
+    void attachRegion(size_t r, const float* values) { regions[r] = values; owned[r].reset(); }
+
+    size_t regionCount() const { return awake.size(); }
+    bool regionAwake(size_t r) const { return awake[r] != 0; }
+    bool regionHot(size_t r) const { return hot[r] != 0; }
+    void setRegion(size_t r, bool isAwake, bool isHot) { awake[r] = isAwake; hot[r] = isHot; }
+
+private:
+    size_t regionOf(int x, int y) const { return (size_t)(y >> regionShift) * regionsX + (x >> regionShift); }
+    void wakeNeighbours(int rx, int ry);
+    float* ownRegion(size_t r);
+
+    int fieldWidth, fieldHeight;
+    int regionSize, regionShift, regionMask, regionsX, regionsY;
+    float hotThreshold;
+    std::vector<const float*> regions;
+    std::vector<std::unique_ptr<float[]>> owned;    // per region, once it has changed
+    std::vector<float> ambient;     // the block of every region still at ambient
+    std::vector<float> next;        // scratch: the new values of the regions stepped
+    std::vector<float> tile;        // scratch: one region with a ring of its neighbours' values
+    std::vector<uint8_t> awake, hot;
+    std::vector<uint8_t> changed;   // per region: moved more than HEAT_EPSILON in its last step
+    std::vector<uint32_t> active;   // scratch: regions stepped this time
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include "image_io.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#include <png.h>
+
+bool writePPM(FILE* out, int width, int height, const unsigned char* rgb, bool flipY) {
+    if (std::fprintf(out, "P6\n%d %d\n255\n", width, height) < 0)
+        return false;
+    size_t rowBytes = (size_t)width * 3;
+    for (int y = 0; y < height; y++) {
+        int row = flipY ? height - 1 - y : y;
+        if (std::fwrite(rgb + row * rowBytes, 1, rowBytes, out) != rowBytes)
+            return false;
+    }
+    return true;
+}
+
+bool writePPM(const std::string& path, int width, int height, const unsigned char* rgb, bool flipY) {
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out)
+        return false;
+    bool ok = writePPM(out, width, height, rgb, flipY);
+    return std::fclose(out) == 0 && ok;
+}
+
+std::string sequencePath(const std::string& pattern, int index, bool numbered) {
+    // The placeholder is checked and rebuilt here, so the pattern itself is
+    // never handed to printf
+    std::string before, spec, after;
+    int placeholders = 0;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        std::string& text = placeholders ? after : before;
+        if (pattern[i] != '%') {
+            text += pattern[i];
+            continue;
+        }
+        if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+            text += '%';
+            i++;
+            continue;
+        }
+        size_t end = i + 1;
+        while (end < pattern.size() && std::strchr("-+ 0", pattern[end]))
+            end++;
+        size_t digits = end;
+        while (end < pattern.size() && std::isdigit((unsigned char)pattern[end]))
+            end++;
+        if (end == pattern.size() || (pattern[end] != 'd' && pattern[end] != 'i') || end - digits > 2) {
+            placeholders = -1;
+            break;
+        }
+        spec = pattern.substr(i, end - i) + "d";
+        placeholders++;
+        i = end;
+    }
+
+    char number[32];
+    if (placeholders == 1) {
+        std::snprintf(number, sizeof(number), spec.c_str(), index);
+        return before + number + after;
+    }
+    if (!numbered)
+        return pattern;
+    std::snprintf(number, sizeof(number), "_%04d", index);
+    size_t dot = pattern.find_last_of('.');
+    size_t slash = pattern.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) || dot == slash + 1)
+        return pattern + number;
+    return pattern.substr(0, dot) + number + pattern.substr(dot);
+}
+
+// ====================== Image Reading ======================
+static bool readFile(const std::string& path, std::vector<unsigned char>& bytes) {
+    FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in)
+        return false;
+    unsigned char buffer[65536];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), in)) > 0)
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    bool ok = !std::ferror(in);
+    std::fclose(in);
+    return ok;
+}
+
+// ------------------- PPM -------------------
+// Next header number, skipping whitespace and # comments
+static bool ppmNumber(const unsigned char*& p, const unsigned char* end, int& value) {
+    while (p < end && (std::isspace(*p) || *p == '#')) {
+        if (*p == '#')
+            while (p < end && *p != '\n')
+                p++;
+        else
+            p++;
+    }
+    if (p == end || !std::isdigit(*p))
+        return false;
+    long v = 0;
+    while (p < end && std::isdigit(*p) && v <= 1000000)
+        v = v * 10 + (*p++ - '0');
+    value = (int)v;
+    return true;
+}
+
+static const char* readPPM(const std::vector<unsigned char>& bytes, int& width, int& height,
+                           std::vector<unsigned char>& rgba) {
+    const unsigned char* p = bytes.data() + 2;
+    const unsigned char* end = bytes.data() + bytes.size();
+    int channels = bytes[1] == '6' ? 3 : 1;
+    int maxValue;
+    if (!ppmNumber(p, end, width) || !ppmNumber(p, end, height) || !ppmNumber(p, end, maxValue) ||
+        p == end || !std::isspace(*p))
+        return "bad PPM header";
+    p++;    // the single whitespace before the pixels
+    if (width < 1 || height < 1 || width > MAX_IMAGE_SIDE || height > MAX_IMAGE_SIDE ||
+        (size_t)width * height > MAX_IMAGE_PIXELS || maxValue < 1 || maxValue > 65535)
+        return "unsupported PPM size";
+    int sampleBytes = maxValue > 255 ? 2 : 1;
+    size_t count = (size_t)width * height;
+    if ((size_t)(end - p) < count * channels * sampleBytes)
+        return "truncated PPM";
+    rgba.resize(count * 4);
+    for (size_t i = 0; i < count; i++) {
+        for (int c = 0; c < 3; c++) {
+            const unsigned char* s = p + (i * channels + (channels == 3 ? c : 0)) * sampleBytes;
+            unsigned v = sampleBytes == 2 ? (s[0] << 8 | s[1]) : s[0];
+            rgba[i * 4 + c] = (unsigned char)(v * 255 / maxValue);
+        }
+        rgba[i * 4 + 3] = 255;
+    }
+    return nullptr;
+}
+
+// ------------------- PNG -------------------
+// Decoding is left to libpng, which turns every colour type, bit depth and
+// interlacing into 8-bit RGBA through its transforms. Its errors longjmp
+// back into readPNG, so everything that must be cleaned up or outlive that
+// lives in a PngReader held by the caller.
+struct PngReader {
+    png_structp png = nullptr;
+    png_infop info = nullptr;
+    const unsigned char* data = nullptr;
+    size_t size = 0, at = 0;
+    char error[128] = "bad PNG";
+    std::vector<png_bytep> rows;
+
+    ~PngReader() {
+        png_destroy_read_struct(&png, info ? &info : nullptr, nullptr);
+    }
+};
+
+static void pngRead(png_structp png, png_bytep out, size_t length) {
+    PngReader* reader = (PngReader*)png_get_io_ptr(png);
+    if (length > reader->size - reader->at)
+        png_error(png, "truncated PNG");
+    std::memcpy(out, reader->data + reader->at, length);
+    reader->at += length;
+}
+
+static void pngError(png_structp png, png_const_charp message) {
+    PngReader* reader = (PngReader*)png_get_error_ptr(png);
+    std::snprintf(reader->error, sizeof(reader->error), "%s", message);
+    png_longjmp(png, 1);
+}
+
+static void pngWarning(png_structp, png_const_charp) {}
+
+// Deflate codes at best a 258 byte match in two bits
+const size_t DEFLATE_MAX_RATIO = 1032;
+
+static const char* readPNG(PngReader& reader, const std::vector<unsigned char>& bytes, int& width, int& height,
+                           std::vector<unsigned char>& rgba) {
+    reader.data = bytes.data();
+    reader.size = bytes.size();
+    reader.png = png_create_read_struct(PNG_LIBPNG_VER_STRING, &reader, pngError, pngWarning);
+    if (!reader.png || !(reader.info = png_create_info_struct(reader.png)))
+        return "out of memory";
+    if (setjmp(png_jmpbuf(reader.png)))
+        return reader.error;
+    png_structp png = reader.png;
+    png_infop info = reader.info;
+    png_set_read_fn(png, &reader, pngRead);
+    png_set_user_limits(png, MAX_IMAGE_SIDE, MAX_IMAGE_SIDE);
+    png_set_chunk_malloc_max(png, (size_t)1 << 24);   // text and profiles too
+    png_read_info(png, info);
+
+    uint32_t w = png_get_image_width(png, info), h = png_get_image_height(png, info);
+    if ((size_t)w * h > MAX_IMAGE_PIXELS)
+        return "unsupported PNG size";
+    // The header's size is only trusted as far as the data could fill it
+    if ((size_t)h * (1 + png_get_rowbytes(png, info)) / DEFLATE_MAX_RATIO > bytes.size())
+        return "truncated PNG";
+
+    int colorType = png_get_color_type(png, info);
+    if (colorType == PNG_COLOR_TYPE_PALETTE)
+        png_set_palette_to_rgb(png);
+    if (colorType == PNG_COLOR_TYPE_GRAY && png_get_bit_depth(png, info) < 8)
+        png_set_expand_gray_1_2_4_to_8(png);
+    bool transparency = png_get_valid(png, info, PNG_INFO_tRNS);
+    if (transparency)
+        png_set_tRNS_to_alpha(png);
+    png_set_scale_16(png);
+    if (!(colorType & PNG_COLOR_MASK_COLOR))
+        png_set_gray_to_rgb(png);
+    if (!(colorType & PNG_COLOR_MASK_ALPHA) && !transparency)
+        png_set_add_alpha(png, 0xff, PNG_FILLER_AFTER);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+    if (png_get_rowbytes(png, info) != (size_t)w * 4)
+        return "unsupported PNG format";
+
+    width = (int)w;
+    height = (int)h;
+    rgba.resize((size_t)w * h * 4);
+    reader.rows.resize(h);
+    for (uint32_t y = 0; y < h; y++)
+        reader.rows[y] = &rgba[(size_t)y * w * 4];
+    png_read_image(png, reader.rows.data());
+    png_read_end(png, nullptr);
+    return nullptr;
+}
+
+bool readImage(const std::string& path, int& width, int& height, std::vector<unsigned char>& rgba) {
+    static const unsigned char PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    const char* error = "not a PNG or binary PPM image";
+    PngReader reader;
+    try {
+        std::vector<unsigned char> bytes;
+        if (!readFile(path, bytes)) {
+            std::cerr << "Failed to read " << path << "\n";
+            return false;
+        }
+        if (bytes.size() >= 8 && !std::memcmp(bytes.data(), PNG_SIGNATURE, 8))
+            error = readPNG(reader, bytes, width, height, rgba);
+        else if (bytes.size() >= 3 && bytes[0] == 'P' && (bytes[1] == '5' || bytes[1] == '6'))
+            error = readPPM(bytes, width, height, rgba);
+    } catch (const std::bad_alloc&) {
+        rgba.clear();
+        error = "out of memory";
+    }
+    if (error) {
+        std::cerr << "Failed to read " << path << ": " << error << "\n";
+        return false;
+    }
+    return true;
+}
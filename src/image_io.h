@@ -0,0 +1,30 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Write tightly packed 8-bit RGB pixels as a binary PPM (P6). GL reads
+// bottom-up, so flipY writes the rows in reverse.
+bool writePPM(const std::string& path, int width, int height, const unsigned char* rgb, bool flipY);
+
+// Same, to an already open stream (used for pipes and image sequences)
+bool writePPM(FILE* out, int width, int height, const unsigned char* rgb, bool flipY);
+
+// Path of frame index in an image sequence. A pattern with exactly one
+// printf-style integer placeholder (%d, %04d, %5i) gets index in its place,
+// and %% there is a literal %. Any other pattern is used as it is, with
+// _NNNN added before its extension when numbered.
+std::string sequencePath(const std::string& pattern, int index, bool numbered);
+
+// Read a binary PPM (P6, or P5 greyscale) or, through libpng, a PNG of any
+// colour type, bit depth and interlacing into 8-bit RGBA, top row first. Sides are limited
+// to MAX_IMAGE_SIDE and the whole image to MAX_IMAGE_PIXELS; nothing is
+// allocated for a size the file's data couldn't fill. Prints the reason and
+// returns false on failure, running out of memory included.
+const int MAX_IMAGE_SIDE = 65535;
+const size_t MAX_IMAGE_PIXELS = (size_t)1 << 28;   // 1 GB as RGBA
+bool readImage(const std::string& path, int& width, int& height, std::vector<unsigned char>& rgba);
+
+#endif
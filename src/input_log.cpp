@@ -0,0 +1,197 @@
+#include "input_log.h"
+
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+
+static const char INPUT_LOG_MAGIC[8] = { 'S', 'A', 'N', 'D', 'I', 'N', 'P', 'T' };
+const uint8_t INPUT_EVENT_SPAWN = 0;
+const uint8_t INPUT_EVENT_STOP = 1;
+const uint8_t INPUT_EVENT_END = 2;
+
+// ------------------- Recording -------------------
+InputRecorder::InputRecorder()
+    : file(nullptr), lastEventTick(0), nextTick(0), events(0) {}
+
+InputRecorder::~InputRecorder() {
+    close();
+}
+
+bool InputRecorder::open(const std::string& path, const InputLogStart& start) {
+    close();
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to open " << path << " for writing\n";
+        return false;
+    }
+    char engine[INPUT_LOG_ENGINE_NAME] = {};
+    std::strncpy(engine, start.engine.c_str(), INPUT_LOG_ENGINE_NAME - 1);
+    uint32_t version = INPUT_LOG_VERSION;
+    uint32_t width = (uint32_t)start.width, height = (uint32_t)start.height;
+    std::fwrite(INPUT_LOG_MAGIC, 1, sizeof(INPUT_LOG_MAGIC), file);
+    std::fwrite(&version, sizeof(version), 1, file);
+    std::fwrite(&start.seed, sizeof(start.seed), 1, file);
+    std::fwrite(&width, sizeof(width), 1, file);
+    std::fwrite(&height, sizeof(height), 1, file);
+    std::fwrite(&start.tick, sizeof(start.tick), 1, file);
+    std::fwrite(engine, 1, sizeof(engine), file);
+    for (const std::string* text : { &start.loadPath, &start.importPath, &start.palettePath }) {
+        uint32_t length = (uint32_t)text->size();
+        std::fwrite(&length, sizeof(length), 1, file);
+        std::fwrite(text->data(), 1, text->size(), file);
+    }
+    if (std::fflush(file) != 0 || std::ferror(file)) {
+        std::cerr << "Failed to write " << path << "\n";
+        close();
+        return false;
+    }
+
+    // A fresh recorder starts idle, the same as World::applyInput's default
+    last = TickInput();
+    lastEventTick = nextTick = start.tick;
+    events = 0;
+    return true;
+}
+
+void InputRecorder::putEvent(uint64_t tick, uint8_t kind) {
+    uint64_t delta = tick - lastEventTick;
+    lastEventTick = tick;
+    do {
+        uint8_t byte = (uint8_t)(delta & 0x7f);
+        delta >>= 7;
+        std::fputc(byte | (delta ? 0x80 : 0), file);
+    } while (delta);
+    std::fputc(kind, file);
+    events++;
+}
+
+void InputRecorder::record(uint64_t tick, const TickInput& input) {
+    if (!file)
+        return;
+    nextTick = tick + 1;
+    if (input.sameEffect(last))
+        return;
+    last = input;
+    if (input.spawning) {
+        putEvent(tick, INPUT_EVENT_SPAWN);
+        uint16_t xy[2] = { (uint16_t)input.gridX, (uint16_t)input.gridY };
+        std::fwrite(xy, sizeof(uint16_t), 2, file);
+        std::fputc(input.material, file);
+    } else {
+        putEvent(tick, INPUT_EVENT_STOP);
+    }
+    std::fflush(file);
+}
+
+void InputRecorder::close() {
+    if (!file)
+        return;
+    putEvent(nextTick, INPUT_EVENT_END);
+    if (std::fclose(file) != 0)
+        std::cerr << "Failed to finish the input log\n";
+    file = nullptr;
+}
+
+// ------------------- Replay -------------------
+bool InputReplay::open(const std::string& path) {
+    auto fail = [&](const char* why) {
+        std::cerr << "Failed to read " << path << ": " << why << "\n";
+        return false;
+    };
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return fail("cannot open file");
+    std::vector<uint8_t> bytes;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    std::fclose(file);
+
+    const uint8_t* pos = bytes.data();
+    const uint8_t* end = pos + bytes.size();
+    auto get = [&](void* data, size_t size) {
+        if ((size_t)(end - pos) < size)
+            return false;
+        std::memcpy(data, pos, size);
+        pos += size;
+        return true;
+    };
+
+    char magic[8];
+    uint32_t version, width, height;
+    char engine[INPUT_LOG_ENGINE_NAME];
+    if (!get(magic, sizeof(magic)) || std::memcmp(magic, INPUT_LOG_MAGIC, sizeof(magic)) != 0)
+        return fail("not an input log");
+    if (!get(&version, sizeof(version)) || version != INPUT_LOG_VERSION)
+        return fail("unsupported version");
+    if (!get(&startState.seed, sizeof(startState.seed)) || !get(&width, sizeof(width)) ||
+        !get(&height, sizeof(height)) || !get(&startState.tick, sizeof(startState.tick)) ||
+        !get(engine, sizeof(engine)))
+        return fail("truncated header");
+    engine[INPUT_LOG_ENGINE_NAME - 1] = '\0';
+    startState.width = (int)width;
+    startState.height = (int)height;
+    startState.engine = engine;
+    for (std::string* text : { &startState.loadPath, &startState.importPath, &startState.palettePath }) {
+        uint32_t length;
+        if (!get(&length, sizeof(length)) || (size_t)(end - pos) < length)
+            return fail("truncated header");
+        text->assign((const char*)pos, length);
+        pos += length;
+    }
+
+    events.clear();
+    next = 0;
+    current = TickInput();
+    uint64_t tick = startState.tick;
+    lastTick = tick;
+    bool ended = false;
+    while (pos < end && !ended) {
+        uint64_t delta = 0;
+        int shift = 0;
+        uint8_t byte = 0x80;
+        while ((byte & 0x80) && pos < end && shift < 64) {
+            byte = *pos++;
+            delta |= (uint64_t)(byte & 0x7f) << shift;
+            shift += 7;
+        }
+        uint8_t kind;
+        if ((byte & 0x80) || !get(&kind, 1))
+            break;
+        tick += delta;
+
+        Event event;
+        event.tick = tick;
+        if (kind == INPUT_EVENT_SPAWN) {
+            uint16_t xy[2];
+            if (!get(xy, sizeof(xy)) || !get(&event.input.material, 1))
+                break;
+            event.input.spawning = true;
+            event.input.gridX = xy[0];
+            event.input.gridY = xy[1];
+        } else if (kind == INPUT_EVENT_END) {
+            ended = true;
+        } else if (kind != INPUT_EVENT_STOP) {
+            return fail("bad event");
+        }
+        if (ended)
+            lastTick = tick;
+        else
+            events.push_back(event);
+    }
+    if (!ended) {
+        // Cut short: the last event is all we know of the rest
+        lastTick = events.empty() ? startState.tick : events.back().tick + 1;
+        std::cerr << "Warning: " << path << " ends without its end event, replaying up to tick " << lastTick << "\n";
+    }
+    return true;
+}
+
+TickInput InputReplay::inputAt(uint64_t tick) {
+    while (next < events.size() && events[next].tick <= tick)
+        current = events[next++].input;
+    if (tick >= lastTick)
+        current = TickInput();
+    return current;
+}
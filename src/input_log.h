@@ -0,0 +1,118 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// ====================== Input Logs ======================
+// Everything outside the World that decides how a run unfolds: the world it
+// starts from (seed, size, engine, a world file or an imported image) and
+// the input applied at each tick. Recording a session and replaying its log with the same
+// starting world reproduces it tick for tick, windowed or headless, however
+// fast or slow the replay runs.
+//
+//   header   "SANDINPT", u32 version, u32 seed, u32 width, u32 height,
+//            u64 start tick, char engine[16], then three u32 length +
+//            string fields: world file, imported image and its palette
+//            (empty when not used)
+//   events   varint ticks since the previous event (the first one since the
+//            start tick), then a u8 kind: INPUT_EVENT_SPAWN followed by
+//            u16 x, u16 y, u8 material; INPUT_EVENT_STOP; or INPUT_EVENT_END,
+//            written when recording stops
+//
+// Only changes are logged: a tick whose input has the same effect as the
+// one before takes no space, a moving brush about eight bytes.
+const uint32_t INPUT_LOG_VERSION = 2;
+const int INPUT_LOG_ENGINE_NAME = 16;   // bytes, NUL padded
+
+// The input World::applyInput takes at one tick
+struct TickInput {
+    bool spawning = false;
+    int gridX = 0, gridY = 0;
+    uint8_t material = 0;
+
+    // Same effect on the world: where and what don't matter while idle
+    bool sameEffect(const TickInput& other) const {
+        return spawning == other.spawning &&
+               (!spawning || (gridX == other.gridX && gridY == other.gridY && material == other.material));
+    }
+};
+
+// How the recorded run started
+struct InputLogStart {
+    uint32_t seed = 0;
+    int width = 0, height = 0;
+    uint64_t tick = 0;
+    std::string engine;
+    std::string loadPath;
+    std::string importPath, palettePath;
+};
+
+// Appends the input of every tick to a log file. A tick whose input didn't
+// change costs a comparison; an event is flushed as it is written, so the
+// log of a session that crashes is complete up to the crash.
+class InputRecorder
+{
+public:
+    InputRecorder();
+    ~InputRecorder();   // writes the end event
+    InputRecorder(const InputRecorder&) = delete;
+    InputRecorder& operator=(const InputRecorder&) = delete;
+
+    // Create path and write the header. Prints the reason and returns false
+    // on failure.
+    bool open(const std::string& path, const InputLogStart& start);
+
+    // The input applied at tick, before the world steps it. Ticks must
+    // increase by one from the start tick.
+    void record(uint64_t tick, const TickInput& input);
+
+    // Write the end event (at the tick after the last one recorded) and close
+    void close();
+
+    uint64_t eventsWritten() const { return events; }
+
+private:
+    void putEvent(uint64_t tick, uint8_t kind);
+
+    FILE* file;
+    TickInput last;
+    uint64_t lastEventTick;
+    uint64_t nextTick;
+    uint64_t events;
+};
+
+// Reads a whole log and hands out the input for each tick in turn
+class InputReplay
+{
+public:
+    // Prints the reason and returns false if the log can't be read. A log
+    // cut short (a session that crashed) replays up to its last full event.
+    bool open(const std::string& path);
+
+    const InputLogStart& start() const { return startState; }
+
+    // The input recorded for tick; ticks must not go backwards. Past the end
+    // of the log nothing is spawned.
+    TickInput inputAt(uint64_t tick);
+
+    // Tick at which the recording stopped (or its last event, if cut short)
+    uint64_t endTick() const { return lastTick; }
+    bool finished(uint64_t tick) const { return tick >= lastTick; }
+
+private:
+    struct Event {
+        uint64_t tick;
+        TickInput input;
+    };
+
+    InputLogStart startState;
+    std::vector<Event> events;
+    size_t next = 0;
+    TickInput current;
+    uint64_t lastTick = 0;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include "lod.h"
+
+uint8_t dominantMaterial(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    uint8_t m[4] = { a, b, c, d };
+    uint8_t best = 0;
+    int bestCount = 0, filled = 0;
+    for (int i = 0; i < 4; i++) {
+        if (m[i] == 0) continue;
+        filled++;
+        int count = 0;
+        for (int j = 0; j < 4; j++)
+            count += m[j] == m[i];
+        if (count > bestCount) {
+            bestCount = count;
+            best = m[i];
+        }
+    }
+    return filled >= 2 ? best : 0;
+}
+
+void buildChunkLod(const uint8_t* material, int stride, int width, int height,
+                   int tileSize, int levels, std::vector<uint8_t>& texels) {
+    texels.assign(lodLevelOffset(tileSize, levels), 0);
+
+    // Level 0: straight copy of the region, padding stays empty
+    for (int y = 0; y < height; y++) {
+        const uint8_t* src = material + (size_t)y * stride;
+        uint8_t* dst = texels.data() + (size_t)y * tileSize;
+        for (int x = 0; x < width; x++)
+            dst[x] = src[x];
+    }
+
+    // Every other level from the one below
+    for (int level = 1; level < levels; level++) {
+        int srcSide = tileSize >> (level - 1);
+        int side = tileSize >> level;
+        const uint8_t* src = texels.data() + lodLevelOffset(tileSize, level - 1);
+        uint8_t* dst = texels.data() + lodLevelOffset(tileSize, level);
+        for (int y = 0; y < side; y++) {
+            const uint8_t* row0 = src + (size_t)(2 * y) * srcSide;
+            const uint8_t* row1 = row0 + srcSide;
+            for (int x = 0; x < side; x++)
+                dst[(size_t)y * side + x] = dominantMaterial(row0[2 * x], row0[2 * x + 1], row1[2 * x], row1[2 * x + 1]);
+        }
+    }
+}
@@ -0,0 +1,25 @@
+// LOD fragment shader: one texel fetch from the chosen pyramid level
+#version 330 core
+in vec2 vGridPos;
+out vec4 FragColor;
+
+uniform usampler2D cells;  // material per cell, mip n = LOD level n (2^n cells per texel side)
+uniform int level;
+uniform vec3 palette[16];  // base colour per material id (MATERIALS table)
+
+float cellHash(vec2 cell)
+{
+    return fract(sin(dot(cell, vec2(12.9898, 78.233))) * 43758.5453);
+}
+
+void main()
+{
+    ivec2 texel = ivec2(floor(vGridPos)) >> level;
+    uint material = texelFetch(cells, texel, level).r;
+    if (material == 0u)
+        discard;
+
+    // Same colouring as test.frag, with the grain hashed per texel
+    float shade = cellHash(vec2(texel));
+    FragColor = vec4(palette[material] * (0.85 + 0.15 * shade), 1.0);
+}
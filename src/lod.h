@@ -0,0 +1,37 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Level-of-detail pyramid of the cell grid, built per chunk tile.
+//
+// Level 0 is the material of every cell; each further level halves both
+// sides, keeping the dominant material of every 2x2 block. A tile of
+// tileSize x tileSize cells stores all levels down to 1x1 back to back in
+// one byte array, so a changed chunk is rebuilt and uploaded on its own.
+
+// Byte offset of a level inside a tile's texels
+inline size_t lodLevelOffset(int tileSize, int level)
+{
+    size_t offset = 0;
+    for (int l = 0; l < level; l++) {
+        size_t side = (size_t)(tileSize >> l);
+        offset += side * side;
+    }
+    return offset;
+}
+
+// Dominant material of a 2x2 block: the most common non-empty material if
+// at least half the block is filled, otherwise empty. Thin features such as
+// a one-cell stream stay visible at coarse levels instead of averaging away.
+uint8_t dominantMaterial(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
+
+// Fill texels with every level of a tile. material points at the tile's
+// bottom-left cell, rows stride apart; cells outside the width x height
+// region (past the world edge) count as empty.
+void buildChunkLod(const uint8_t* material, int stride, int width, int height,
+                   int tileSize, int levels, std::vector<uint8_t>& texels);
+
+#endif
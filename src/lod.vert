@@ -0,0 +1,18 @@
+// LOD vertex shader: one quad over the visible part of the grid
+#version 330 core
+
+layout (location = 0) in vec3 aPos;       // base square vertex, -0.5 .. 0.5
+
+out vec2 vGridPos;
+
+uniform mat3 viewProj;     // grid -> NDC (camera zoom/pan)
+uniform vec4 rect;         // grid-space x0, y0, x1, y1 to cover
+
+void main()
+{
+    vec2 cell = mix(rect.xy, rect.zw, aPos.xy + 0.5);
+    vec3 pos = viewProj * vec3(cell, 1.0);
+
+    gl_Position = vec4(pos.xy, 0.0, 1.0);
+    vGridPos = cell;
+}
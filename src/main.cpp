@@ -1,115 +1,494 @@
 #include <iostream>
-#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <climits>
+#include <memory>
+#include <random>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
-#include <random>
-#include "shader.h"
+#include "camera.h"
+#include "capture.h"
+#include "checkpoint.h"
+#include "headless.h"
+#include "input_log.h"
+#include "image_io.h"
+#include "pacing.h"
+#include "renderer.h"
+#include "simulation.h"
+#include "terrain.h"
 
 // ====================== Globals & Constants ======================
 const unsigned int SCR_WIDTH  = 1000;
 const unsigned int SCR_HEIGHT = 1000;
-const unsigned int MAX_PARTICLES = 100000;
-const int GRID_SIZE = 300;
-float cellWidth  = 2.0f / GRID_SIZE;
-float cellHeight = 2.0f / GRID_SIZE;
 
 // Mouse state tracking
 bool mousePressed = false;
-float lastSpawnTime = 0.0f;
-const float SPAWN_RATE = 100.0f; // particles per second when holding mouse
 
-// Random number generator for sliding direction
-std::random_device rd;
-std::mt19937 gen(rd());
-std::uniform_int_distribution<> slideDir(0, 1); // 0 = left first, 1 = right first
+// Material poured by the left mouse button, picked with the number keys
+uint8_t brushMaterial = MAT_SAND;
+
+// Turbo toggle (edge-triggered on the T key)
+bool turboKeyDown = false;
+bool turboToggled = false;
+
+// Capture toggle (edge-triggered on F9)
+bool captureKeyDown = false;
+bool captureToggled = false;
+
+// Save request (edge-triggered on F5)
+bool saveKeyDown = false;
+bool saveRequested = false;
+
+// Camera: scroll zooms around the cursor, right-drag pans, Home resets
+Camera camera;
+double pendingScroll = 0.0;
+bool panning = false;
+double panLastX = 0.0, panLastY = 0.0;
+bool resetView = false;
+
+// ====================== Command Line ======================
+struct Options {
+    PacingSettings pacing;
+    double runForSeconds = 0.0;   // 0 = until the window is closed
+    std::string capturePath;      // start capturing immediately when set
+
+    // headless batch rendering
+    bool headless = false;
+    int ticksPerFrame = 600;
+    int frames = 1;
+    int width = SCR_WIDTH;
+    int height = SCR_HEIGHT;
+    std::string output = "frame.ppm";
+    bool hasSeed = false;
+    uint32_t seed = 0;
+
+    int worldWidth = DEFAULT_GRID_SIZE;
+    int worldHeight = DEFAULT_GRID_SIZE;
+    uint8_t material = MAT_SAND;   // initial brush / headless pour
+    std::string engine = "auto";   // registry name, auto = fastest default engine for this CPU
+    std::string loadPath;          // world file to start from
+    std::string importPath;        // image to start from
+    std::string palettePath;       // colour -> material map for importPath, empty = material colours
+    std::string savePath;          // F5 target; headless saves here once done
+    std::string checkpointPath;    // autosave target, off when empty
+    double checkpointSeconds = 5.0;
+    std::string recordPath;        // input log written while running
+    std::string replayPath;        // input log to reproduce instead of live input
+};
+
+void printUsage(const char* exe) {
+    std::cout << "Usage: " << exe << " [options]\n"
+              << "  --fps N        target display rate (default 60)\n"
+              << "  --vsync        pace with the swap interval instead of the frame pacer\n"
+              << "  --uncapped     run the simulation as fast as possible\n"
+              << "  --turbo        uncapped simulation, display at --turbo-fps\n"
+              << "  --turbo-fps N  display rate while in turbo (default 5)\n"
+              << "  --run-for S    quit after S seconds (handy for benchmarking)\n"
+              << "  --capture PATH record frames: file.y4m, cap_%05d.ppm or \"|command\" (Y4M on stdin)\n"
+              << "  --seed N       fixed random seed for reproducible runs\n"
+              << "  --world WxH    world size in cells (default 300x300, up to 65535 per side)\n"
+              << "  --material M   initial brush and headless pour material (sand, water, stone, gas, fire, oil,\n"
+              << "                 smoke, steam, lava, wood, glass)\n"
+              << "  --engine E     how cells move (default auto: fastest of the \"" << DEFAULT_ENGINE_FAMILY << "\" family for this CPU)\n"
+              << "  --load FILE    start from a saved world (its size overrides --world)\n"
+              << "  --import IMAGE start from a PNG or PPM image, one cell per pixel (its size overrides --world)\n"
+              << "  --palette FILE \"RRGGBB material\" lines mapping --import colours (default: material colours, black empty)\n"
+              << "  --save FILE    where F5 saves the world (default world.sand); headless: save when done\n"
+              << "  --checkpoint FILE  autosave the changed chunks to a paged world file in the background\n"
+              << "  --checkpoint-every S  simulated seconds between checkpoints (default 5)\n"
+              << "  --record FILE  log the starting world and every tick's input for --replay\n"
+              << "  --replay FILE  rerun a recorded session: its world, engine and input replace the options\n"
+              << "  --headless     render offscreen (EGL) without a window and write PPM files\n"
+              << "  --ticks N      headless: simulation ticks per written frame (default 600)\n"
+              << "  --frames N     headless: number of frames to write (default 1)\n"
+              << "  --size WxH     headless: output resolution (default 1000x1000)\n"
+              << "  --output PATH  headless: output file; %d or %04d marks the frame number, else _NNNN is\n"
+              << "                 added for --frames above 1\n"
+              << "Engines (CPU: " << cpuFeatureNames(detectCpuFeatures()) << "):\n";
+    for (const auto& e : EngineRegistry::instance().engines())
+        std::cout << "  " << e.name << " - " << e.description
+                  << (e.requiredCpu ? " (needs " + cpuFeatureNames(e.requiredCpu) + ")" : std::string()) << "\n";
+}
+
+// A checkpoint interval: a plain positive number of seconds whose tick
+// count fits an int
+bool parseInterval(const char* text, double& seconds) {
+    char* end = nullptr;
+    double value = std::strtod(text, &end);
+    if (end == text || *end != '\0' || !(value > 0.0) || value * TICK_RATE >= INT_MAX)
+        return false;
+    seconds = value;
+    return true;
+}
+
+bool parseArgs(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--fps" && hasValue)            opts.pacing.targetFps = std::atof(argv[++i]);
+        else if (arg == "--turbo-fps" && hasValue) opts.pacing.turboFps = std::atof(argv[++i]);
+        else if (arg == "--run-for" && hasValue)   opts.runForSeconds = std::atof(argv[++i]);
+        else if (arg == "--seed" && hasValue)      { opts.seed = (uint32_t)std::strtoul(argv[++i], nullptr, 10); opts.hasSeed = true; }
+        else if (arg == "--ticks" && hasValue)     opts.ticksPerFrame = std::atoi(argv[++i]);
+        else if (arg == "--frames" && hasValue)    opts.frames = std::atoi(argv[++i]);
+        else if (arg == "--output" && hasValue)    opts.output = argv[++i];
+        else if (arg == "--capture" && hasValue)   opts.capturePath = argv[++i];
+        else if (arg == "--size" && hasValue && std::sscanf(argv[i + 1], "%dx%d", &opts.width, &opts.height) == 2) i++;
+        else if (arg == "--world" && hasValue && std::sscanf(argv[i + 1], "%dx%d", &opts.worldWidth, &opts.worldHeight) == 2) i++;
+        else if (arg == "--material" && hasValue && materialByName(argv[i + 1]) != MAT_COUNT) opts.material = materialByName(argv[++i]);
+        else if (arg == "--engine" && hasValue)    opts.engine = argv[++i];
+        else if (arg == "--load" && hasValue)      opts.loadPath = argv[++i];
+        else if (arg == "--import" && hasValue)    opts.importPath = argv[++i];
+        else if (arg == "--palette" && hasValue)   opts.palettePath = argv[++i];
+        else if (arg == "--save" && hasValue)      opts.savePath = argv[++i];
+        else if (arg == "--checkpoint" && hasValue) opts.checkpointPath = argv[++i];
+        else if (arg == "--checkpoint-every" && hasValue && parseInterval(argv[i + 1], opts.checkpointSeconds)) i++;
+        else if (arg == "--record" && hasValue)    opts.recordPath = argv[++i];
+        else if (arg == "--replay" && hasValue)    opts.replayPath = argv[++i];
+        else if (arg == "--headless")              opts.headless = true;
+        else if (arg == "--vsync")                 opts.pacing.vsync = true;
+        else if (arg == "--uncapped")              opts.pacing.uncapped = true;
+        else if (arg == "--turbo")                 opts.pacing.turbo = true;
+        else {
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    if (opts.ticksPerFrame <= 0 || opts.frames <= 0 || opts.width <= 0 || opts.height <= 0) {
+        std::cerr << "--ticks, --frames and --size must be positive\n";
+        return false;
+    }
+    return true;
+}
+
+// Plug the engine named on the command line into the world
+bool selectEngine(World& world, const std::string& name) {
+    std::unique_ptr<SimulationEngine> engine = EngineRegistry::instance().create(name);
+    if (!engine) {
+        std::cerr << "Unknown engine or not supported by this CPU: " << name << "\n";
+        return false;
+    }
+    std::cout << "Simulation engine: " << engine->name() << " (CPU: " << cpuFeatureNames(detectCpuFeatures()) << ")\n";
+    world.setEngine(std::move(engine));
+    return true;
+}
+
+// Fill the world from the --import image
+bool importWorld(World& world, const Options& opts) {
+    TerrainPalette palette = defaultTerrainPalette();
+    if (!opts.palettePath.empty() && !loadTerrainPalette(opts.palettePath, palette))
+        return false;
+    auto start = std::chrono::steady_clock::now();
+    if (!importTerrain(world, opts.importPath, palette))
+        return false;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Imported " << opts.importPath << " (" << world.width() << "x" << world.height() << ", "
+              << world.movingCount() << " cells moving, " << ms << " ms)\n";
+    if (world.movingCount() >= MAX_PARTICLES)
+        std::cout << "Warning: more loose cells than the particle limit, the rest start at rest\n";
+    return true;
+}
+
+// Build the world described by the options: the engine from --engine, the
+// contents from --load or --import if given
+bool setupWorld(World& world, const Options& opts) {
+    if (!selectEngine(world, opts.engine))
+        return false;
+    if (!opts.loadPath.empty() && !opts.importPath.empty()) {
+        std::cerr << "--load and --import both give the starting world, use one\n";
+        return false;
+    }
+    if (!opts.importPath.empty())
+        return importWorld(world, opts);
+    if (opts.loadPath.empty())
+        return true;
+    if (!world.load(opts.loadPath))
+        return false;
+    std::cout << "Loaded " << opts.loadPath << " (" << world.width() << "x" << world.height()
+              << ", tick " << world.tick() << ")\n";
+    return true;
+}
+
+// Take the starting world from the --replay log: seed, size, engine and the
+// world file it was loaded from
+bool startReplay(Options& opts, InputReplay& replay) {
+    if (!replay.open(opts.replayPath))
+        return false;
+    const InputLogStart& start = replay.start();
+    opts.hasSeed = true;
+    opts.seed = start.seed;
+    opts.worldWidth = start.width;
+    opts.worldHeight = start.height;
+    opts.engine = start.engine;
+    opts.loadPath = start.loadPath;
+    opts.importPath = start.importPath;
+    opts.palettePath = start.palettePath;
+    std::cout << "Replaying " << opts.replayPath << ": ticks " << start.tick << " to " << replay.endTick()
+              << ", seed " << start.seed << ", " << start.width << "x" << start.height << ", engine " << start.engine
+              << (start.loadPath.empty() ? std::string() : ", from " + start.loadPath)
+              << (start.importPath.empty() ? std::string() : ", imported from " + start.importPath) << "\n";
+    return true;
+}
+
+// After setupWorld: check the replayed world starts where the log does and
+// open the --record log
+bool startInputLogs(const Options& opts, const World& world, const InputReplay* replay, InputRecorder& recorder) {
+    if (replay && world.tick() != replay->start().tick) {
+        std::cerr << "The input log starts at tick " << replay->start().tick << " but " << opts.loadPath
+                  << " is at tick " << world.tick() << "\n";
+        return false;
+    }
+    if (opts.recordPath.empty())
+        return true;
+    InputLogStart start;
+    start.seed = opts.seed;
+    start.width = world.width();
+    start.height = world.height();
+    start.tick = world.tick();
+    start.engine = world.engine().name();
+    start.loadPath = opts.loadPath;
+    start.importPath = opts.importPath;
+    start.palettePath = opts.palettePath;
+    if (!recorder.open(opts.recordPath, start))
+        return false;
+    std::cout << "Recording input to " << opts.recordPath << " (seed " << opts.seed << ")\n";
+    return true;
+}
+
+// Close the --record log and say how far a replay got
+void finishInputLogs(const Options& opts, const World& world, const InputReplay* replay, InputRecorder& recorder) {
+    if (!opts.recordPath.empty()) {
+        recorder.close();
+        std::cout << "Recorded " << recorder.eventsWritten() << " input events to " << opts.recordPath
+                  << " (to tick " << world.tick() << ")\n";
+    }
+    if (replay && !replay->finished(world.tick()))
+        std::cout << "Replay stopped at tick " << world.tick() << " of " << replay->endTick() << "\n";
+    else if (replay)
+        std::cout << "Replay reached the end of the log at tick " << replay->endTick() << "\n";
+}
+
+// Autosave from --checkpoint, or nullptr without it
+std::unique_ptr<Checkpointer> makeCheckpointer(const Options& opts) {
+    if (opts.checkpointPath.empty())
+        return nullptr;
+    int ticks = (int)(opts.checkpointSeconds * TICK_RATE + 0.5);
+    std::cout << "Checkpointing to " << opts.checkpointPath << " every " << std::max(1, ticks) << " ticks\n";
+    return std::unique_ptr<Checkpointer>(new Checkpointer(opts.checkpointPath, ticks));
+}
+
+// Print what the autosave wrote and what it cost the simulation thread
+void reportCheckpoints(const Checkpointer& checkpointer) {
+    std::cout << "Checkpoints written: " << checkpointer.written() << " (" << checkpointer.chunksWritten()
+              << " chunks), longest simulation stall " << checkpointer.longestStallMs() << " ms"
+              << ", last write " << checkpointer.lastWriteMs() << " ms\n";
+    if (checkpointer.overBound())
+        std::cout << "  " << checkpointer.overBound() << " checkpoint(s) had more than " << CHECKPOINT_FINAL_CHUNKS
+                  << " changing chunks left to copy when their tick was fixed\n";
+}
 
 // ====================== Callbacks ======================
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
+    camera.setViewport(width, height);
+}
+
+void scroll_callback(GLFWwindow* /*window*/, double /*xoffset*/, double yoffset) {
+    pendingScroll += yoffset;
+}
+
+// Cursor position in framebuffer pixels (differs from window coords on HiDPI)
+void cursorFramebufferPos(GLFWwindow* window, double& x, double& y) {
+    int winW, winH, fbW, fbH;
+    glfwGetWindowSize(window, &winW, &winH);
+    glfwGetFramebufferSize(window, &fbW, &fbH);
+    glfwGetCursorPos(window, &x, &y);
+    if (winW > 0 && winH > 0) {
+        x *= (double)fbW / winW;
+        y *= (double)fbH / winH;
+    }
 }
 
 void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
-    
+
     // Track mouse button state
     mousePressed = (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS);
-}
 
-// ====================== Particle Struct ======================
-struct Particle {
-    float x, y;
-    float spawnTime;
-    float lastFallTime;
-    bool active;
-    bool settled;
-    
-    Particle() : x(0), y(0), spawnTime(0), lastFallTime(0), active(false), settled(false) {}
-    Particle(float px, float py, float time) : x(px), y(py), spawnTime(time), lastFallTime(time), active(true), settled(false) {}
-};
+    bool turboKey = (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS);
+    if (turboKey && !turboKeyDown)
+        turboToggled = true;
+    turboKeyDown = turboKey;
 
-// Helper function to convert world coordinates to grid coordinates
-void worldToGrid(float worldX, float worldY, int& gridX, int& gridY) {
-    gridX = (int)((worldX + 1.0f) / 2.0f * GRID_SIZE);
-    gridY = (int)((worldY + 1.0f) / 2.0f * GRID_SIZE);
-    
-    // Clamp to valid range
-    gridX = std::max(0, std::min(GRID_SIZE - 1, gridX));
-    gridY = std::max(0, std::min(GRID_SIZE - 1, gridY));
-}
+    bool captureKey = (glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS);
+    if (captureKey && !captureKeyDown)
+        captureToggled = true;
+    captureKeyDown = captureKey;
+
+    bool saveKey = (glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS);
+    if (saveKey && !saveKeyDown)
+        saveRequested = true;
+    saveKeyDown = saveKey;
+
+    if (glfwGetKey(window, GLFW_KEY_HOME) == GLFW_PRESS)
+        resetView = true;
+
+    // 1..9, 0 pick the brush material in table order
+    for (int m = 1; m < MAT_COUNT && m <= 10; m++) {
+        if (glfwGetKey(window, GLFW_KEY_0 + m % 10) == GLFW_PRESS)
+            brushMaterial = (uint8_t)m;
+    }
 
-// Helper function to convert grid coordinates to world coordinates (center of cell)
-void gridToWorld(int gridX, int gridY, float& worldX, float& worldY) {
-    worldX = (gridX + 0.5f) * cellWidth - 1.0f;
-    worldY = (gridY + 0.5f) * cellHeight - 1.0f;
+    // ------------------- Camera -------------------
+    double cursorX, cursorY;
+    cursorFramebufferPos(window, cursorX, cursorY);
+    if (pendingScroll != 0.0) {
+        camera.zoomAt(cursorX, cursorY, std::pow(1.15f, (float)pendingScroll), 0.005f, 64.0f);
+        pendingScroll = 0.0;
+    }
+    bool rightDown = (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS);
+    if (rightDown && panning)
+        camera.pan(cursorX - panLastX, cursorY - panLastY);
+    panning = rightDown;
+    panLastX = cursorX;
+    panLastY = cursorY;
 }
 
-// Check if a grid position is valid and empty
-bool isValidAndEmpty(const std::vector<std::vector<bool>>& grid, int x, int y) {
-    return x >= 0 && x < GRID_SIZE && y >= 0 && y < GRID_SIZE && !grid[x][y];
+// Print how much a finished capture cost the render loop
+void reportCapture(const FrameCapture& capture) {
+    std::cout << "Captured " << capture.framesCaptured() << " frames ("
+              << capture.framesDropped() << " dropped), "
+              << capture.averageCaptureMs() << " ms per frame on the render thread\n";
 }
 
-// Try to slide the particle left or right
-bool trySlide(Particle& p, std::vector<std::vector<bool>>& grid, int currentGridX, int currentGridY) {
-    // Randomly choose which direction to try first
-    bool tryLeftFirst = slideDir(gen) == 0;
-    
-    for (int attempt = 0; attempt < 2; attempt++) {
-        int slideX = currentGridX + (tryLeftFirst ? -1 : 1);
-        
-        // Check if we can slide to this position and then fall
-        if (isValidAndEmpty(grid, slideX, currentGridY)) {
-            // Check if there's space to fall diagonally
-            if (isValidAndEmpty(grid, slideX, currentGridY - 1)) {
-                // Clear current position
-                grid[currentGridX][currentGridY] = false;
-                
-                // Move to slide position and fall
-                gridToWorld(slideX, currentGridY - 1, p.x, p.y);
-                grid[slideX][currentGridY - 1] = true;
-                return true;
+// ====================== Headless Batch Rendering ======================
+// Runs the simulation synchronously with a scripted pour from the top centre
+// (or the input of a --replay log) and writes a frame every ticksPerFrame
+// ticks. With --seed the output is reproducible, which makes it usable for
+// regression images.
+int runHeadless(const Options& opts, InputReplay* replay) {
+#ifdef SAND_HAVE_EGL
+    HeadlessContext context;
+    if (!context.create())
+        return -1;
+    std::cout << "Headless renderer: " << glGetString(GL_RENDERER) << "\n";
+
+    World world = opts.hasSeed ? World(opts.worldWidth, opts.worldHeight, opts.seed)
+                               : World(opts.worldWidth, opts.worldHeight);
+    InputRecorder recorder;
+    if (!setupWorld(world, opts) || !startInputLogs(opts, world, replay, recorder))
+        return -1;
+    std::unique_ptr<Checkpointer> checkpointer = makeCheckpointer(opts);
+    Camera view;
+    view.setViewport(opts.width, opts.height);
+    view.fitWorld(world.width(), world.height());
+    {
+        Renderer renderer;
+        OffscreenTarget target(opts.width, opts.height);
+        RenderSnapshot snapshot;
+        std::vector<unsigned char> pixels;
+        std::unique_ptr<FrameCapture> capture;
+        if (!opts.capturePath.empty())
+            capture.reset(new FrameCapture(opts.width, opts.height, 30, opts.capturePath));
+
+        for (int frame = 0; frame < opts.frames; frame++) {
+            for (int t = 0; t < opts.ticksPerFrame; t++) {
+                TickInput input;
+                if (replay) {
+                    input = replay->inputAt(world.tick());
+                } else {
+                    input.spawning = true;
+                    input.gridX = world.width() / 2;
+                    input.gridY = world.height() - 10;
+                    input.material = opts.material;
+                }
+                recorder.record(world.tick(), input);
+                world.applyInput(input.spawning, input.gridX, input.gridY, input.material);
+                world.step();
+                if (checkpointer)
+                    checkpointer->afterTick(world);
+            }
+
+            world.buildSnapshot(snapshot, view.zoom < LOD_MAX_ZOOM);
+            target.bind();
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            renderer.draw(snapshot, view);
+            if (capture)
+                capture->captureFrame(target.width, target.height);
+            target.readPixels(pixels);
+
+            std::string path = sequencePath(opts.output, frame, opts.frames > 1);
+            if (!writePPM(path, target.width, target.height, pixels.data(), true)) {
+                std::cerr << "Failed to write " << path << "\n";
+                return -1;
             }
+            std::cout << "Wrote " << path << " (tick " << world.tick() << ", "
+                      << snapshot.instances.size() << " moving, ";
+            if (renderer.lastLodLevel() >= 0)
+                std::cout << "LOD level " << renderer.lastLodLevel() << ", ";
+            else
+                std::cout << renderer.lastQuadCount() << " settled quads, ";
+            std::cout << renderer.lastStaticUploadCount() << " chunks uploaded)\n";
+        }
+        if (capture) {
+            capture->finish();
+            reportCapture(*capture);
         }
-        
-        // Try the other direction
-        tryLeftFirst = !tryLeftFirst;
     }
-    
-    return false; // Couldn't slide either direction
+    if (checkpointer) {
+        checkpointer->stop();
+        reportCheckpoints(*checkpointer);
+    }
+    finishInputLogs(opts, world, replay, recorder);
+    if (!opts.savePath.empty()) {
+        auto start = std::chrono::steady_clock::now();
+        if (!world.save(opts.savePath))
+            return -1;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Saved " << opts.savePath << " at tick " << world.tick() << " (" << ms << " ms)\n";
+    }
+    return 0;
+#else
+    (void)opts;
+    (void)replay;
+    std::cerr << "Headless rendering is unavailable: built without EGL\n";
+    return -1;
+#endif
 }
 
-int main() {
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parseArgs(argc, argv, opts))
+        return -1;
+    InputReplay replay;
+    if (!opts.replayPath.empty() && !startReplay(opts, replay))
+        return -1;
+    if (!opts.recordPath.empty() && !opts.hasSeed) {
+        // A log is only worth something with the seed it ran with
+        opts.seed = std::random_device{}();
+        opts.hasSeed = true;
+    }
+    if (opts.headless)
+        return runHeadless(opts, opts.replayPath.empty() ? nullptr : &replay);
+    brushMaterial = opts.material;
+
     // Initialize GLFW
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW\n";
         return -1;
     }
-    
+
     // Configure GLFW
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    
+
     // Create window
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Falling Sand with Sliding", nullptr, nullptr);
     if (!window) {
@@ -119,196 +498,162 @@ int main() {
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    
+    glfwSetScrollCallback(window, scroll_callback);
+
     // Initialize GLAD
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         std::cerr << "Failed to initialize GLAD\n";
         return -1;
     }
-    
-    // Square vertices
-    float vertices[] = {
-        0.5f,  0.5f, 0.0f,
-        0.5f, -0.5f, 0.0f,
-       -0.5f, -0.5f, 0.0f,
-       -0.5f,  0.5f, 0.0f
-    };
-    
-    unsigned int indices[] = { 0, 1, 3, 1, 2, 3 };
-
-    Shader shader("test.vert", "test.frag");
-
-    unsigned int VAO, VBO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-
-    // Vertex buffer
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    // Element buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-    // Vertex attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // Instance buffer for spawn positions
-    unsigned int instanceVBO1;
-    glGenBuffers(1, &instanceVBO1);
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO1);
-    glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 2 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribDivisor(1, 1);
-
-    // Instance buffer for spawn times
-    unsigned int instanceVBO2;
-    glGenBuffers(1, &instanceVBO2);
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO2);
-    glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
-    glEnableVertexAttribArray(2);
-    glVertexAttribDivisor(2, 1);
-
-    glBindVertexArray(0);
-
-    // Initialize grid and particles
-    std::vector<Particle> particles;
-    std::vector<std::vector<bool>> grid(GRID_SIZE, std::vector<bool>(GRID_SIZE, false));
-    
-    float lastTime = glfwGetTime();
-    float fallSpeed = 100.0f; // Random fall speed between 20 and 50
-    
-    // ====================== Render & Update Loop ======================
-    while (!glfwWindowShouldClose(window)) {
-        processInput(window);
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        float currentTime = glfwGetTime();
-        float deltaTime = currentTime - lastTime;
-        lastTime = currentTime;
-
-        // ------------------- Spawn Particle While Mouse Held -------------------
-        if (mousePressed && (currentTime - lastSpawnTime) >= (1.0f / SPAWN_RATE)) {
-            double mouseX, mouseY;
-            glfwGetCursorPos(window, &mouseX, &mouseY);
-            float ndcX = 2.0f * (mouseX / SCR_WIDTH) - 1.0f;
-            float ndcY = 1.0f - 2.0f * (mouseY / SCR_HEIGHT);
-
-            int mouseGridX, mouseGridY;
-            worldToGrid(ndcX, ndcY, mouseGridX, mouseGridY);
-            
-            bool spawned = false;
-            int searchRadius = 3;
-            
-            for (int dy = 0; dy <= searchRadius && !spawned; dy++) {
-                for (int dx = -dy; dx <= dy && !spawned; dx++) {
-                    int checkX = mouseGridX + dx;
-                    int checkY = mouseGridY + dy;
-                    
-                    for (int yOffset : {0, -dy}) {
-                        if (yOffset != 0 && dy == 0) continue;
-                        int finalY = checkY + yOffset;
-                        
-                        if (particles.size() >= MAX_PARTICLES) {
-                            spawned = true;
-                            break;
-                        }
-                        
-                        if (isValidAndEmpty(grid, checkX, finalY)) {
-                            float spawnX, spawnY;
-                            gridToWorld(checkX, finalY, spawnX, spawnY);
-                            particles.emplace_back(spawnX, spawnY, currentTime);
-                            grid[checkX][finalY] = true;
-                            lastSpawnTime = currentTime;
-                            spawned = true;
-                            break;
-                        }
-                    }
-                }
+
+    // Simulation runs on its own thread; we only ever draw its latest snapshot
+    World world = opts.hasSeed ? World(opts.worldWidth, opts.worldHeight, opts.seed)
+                               : World(opts.worldWidth, opts.worldHeight);
+    InputRecorder recorder;
+    if (!setupWorld(world, opts) || !startInputLogs(opts, world, opts.replayPath.empty() ? nullptr : &replay, recorder))
+        return -1;
+    std::unique_ptr<Checkpointer> checkpointer = makeCheckpointer(opts);
+    SimulationThread sim(world);
+    if (!opts.savePath.empty())
+        sim.savePath = opts.savePath;
+    sim.checkpointer = checkpointer.get();
+    if (!opts.recordPath.empty())
+        sim.recorder = &recorder;
+    if (!opts.replayPath.empty())
+        sim.replay = &replay;
+    FramePacer pacer(opts.pacing);
+    uint64_t framesDrawn = 0;
+    uint64_t framesDuplicated = 0;
+
+    int fbWidth, fbHeight;
+    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+    camera.setViewport(fbWidth, fbHeight);
+    camera.fitWorld(world.width(), world.height());
+
+    glfwSwapInterval(pacer.swapInterval());
+    sim.setSpeed(pacer.simSpeed());
+
+    double startTime = glfwGetTime();
+    double lastTitleTime = startTime;
+    uint64_t lastTitleTicks = 0;
+
+    {
+        Renderer renderer;
+        std::unique_ptr<FrameCapture> capture;
+        if (!opts.capturePath.empty())
+            captureToggled = true;
+        sim.start();
+
+        // ====================== Render Loop ======================
+        while (!glfwWindowShouldClose(window)) {
+            processInput(window);
+
+            if (turboToggled) {
+                turboToggled = false;
+                pacer.setTurbo(!pacer.turbo());
+                glfwSwapInterval(pacer.swapInterval());
+                sim.setSpeed(pacer.simSpeed());
             }
-        }
 
-        // ------------------- Update Particles with Sliding Logic -------------------
-        for (int i = particles.size() - 1; i >= 0; --i) {
-            Particle& p = particles[i];
-            if (!p.active || p.settled) continue;
-
-            int currentGridX, currentGridY;
-            worldToGrid(p.x, p.y, currentGridX, currentGridY);
-            
-            float timeSinceLastFall = currentTime - p.lastFallTime;
-            float fallInterval = 1.0f / fallSpeed;
-            
-            if (timeSinceLastFall >= fallInterval) {
-                // Try to fall straight down first
-                if (isValidAndEmpty(grid, currentGridX, currentGridY - 1)) {
-                    // Clear current position
-                    grid[currentGridX][currentGridY] = false;
-                    
-                    // Move down one cell
-                    currentGridY--;
-                    gridToWorld(currentGridX, currentGridY, p.x, p.y);
-                    grid[currentGridX][currentGridY] = true;
-                    
-                    p.lastFallTime = currentTime;
-                } 
-                // If can't fall straight down, try to slide
-                else if (trySlide(p, grid, currentGridX, currentGridY)) {
-                    p.lastFallTime = currentTime;
-                } 
-                // If can't slide either, particle has settled
-                else {
-                    p.settled = true;
+            if (captureToggled) {
+                captureToggled = false;
+                if (capture) {
+                    capture->finish();
+                    reportCapture(*capture);
+                    capture.reset();
+                } else {
+                    int fbWidth, fbHeight;
+                    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+                    std::string path = opts.capturePath.empty() ? "capture.y4m" : opts.capturePath;
+                    capture.reset(new FrameCapture(fbWidth, fbHeight, (int)(pacer.targetFps() + 0.5), path));
+                    if (!capture->ok())
+                        capture.reset();
+                    else
+                        std::cout << "Capturing to " << path << " (F9 to stop)\n";
                 }
             }
-        }
 
-        // ------------------- Fill Instance Buffers -------------------
-        std::vector<float> spawnPositions;
-        std::vector<float> spawnTimes;
-        
-        for (const auto& p : particles) {
-            if (p.active) {
-                spawnPositions.push_back(p.x);
-                spawnPositions.push_back(p.y);
-                spawnTimes.push_back(p.spawnTime);
+            if (saveRequested) {
+                saveRequested = false;
+                sim.input.save.store(true, std::memory_order_relaxed);
+            }
+
+            if (resetView) {
+                resetView = false;
+                camera.fitWorld(world.width(), world.height());
+            }
+
+            // ------------------- Forward Input To Simulation -------------------
+            // Mouse -> grid follows the camera; clamp so holding outside the world pours at its edge
+            double mouseX, mouseY;
+            cursorFramebufferPos(window, mouseX, mouseY);
+            float gridX, gridY;
+            camera.screenToGrid(mouseX, mouseY, gridX, gridY);
+            int mouseGridX = std::max(0, std::min(world.width() - 1, (int)std::floor(gridX)));
+            int mouseGridY = std::max(0, std::min(world.height() - 1, (int)std::floor(gridY)));
+            sim.input.gridX.store(mouseGridX, std::memory_order_relaxed);
+            sim.input.gridY.store(mouseGridY, std::memory_order_relaxed);
+            sim.input.spawning.store(mousePressed, std::memory_order_relaxed);
+            sim.input.material.store(brushMaterial, std::memory_order_relaxed);
+            sim.input.lod.store(camera.zoom < LOD_MAX_ZOOM, std::memory_order_relaxed);
+
+            // ------------------- Draw Latest Snapshot -------------------
+            if (!sim.snapshots.acquire() && framesDrawn > 0)
+                framesDuplicated++;
+            framesDrawn++;
+
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            renderer.draw(sim.snapshots.readBuffer(), camera);
+            if (capture) {
+                int fbWidth, fbHeight;
+                glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+                capture->captureFrame(fbWidth, fbHeight);
+                if (!capture->ok())
+                    captureToggled = true;   // the output went away; stop next frame
             }
-        }
-        
-        unsigned int count = spawnTimes.size();
-
-        if (count > 0) {
-            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO1);
-            glBufferSubData(GL_ARRAY_BUFFER, 0, count * 2 * sizeof(float), spawnPositions.data());
-            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO2);
-            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(float), spawnTimes.data());
-        }
 
-        // ------------------- Draw Particles -------------------
-        if (count > 0) {
-            shader.use();
-            glUniform1f(glGetUniformLocation(shader.ID, "size"), cellWidth);
-            glUniform1f(glGetUniformLocation(shader.ID, "fallspeed"), std::max(0.1f, 0.0f));
-            glUniform1f(glGetUniformLocation(shader.ID, "time"), currentTime);
-            glUniform1f(glGetUniformLocation(shader.ID, "cellWidth"), cellWidth);
-            glUniform1f(glGetUniformLocation(shader.ID, "cellHeight"), cellHeight);
-
-            glBindVertexArray(VAO);
-            glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, count);
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            pacer.endFrame();
+
+            // ------------------- Throughput Readout -------------------
+            double now = glfwGetTime();
+            if (now - lastTitleTime >= 1.0) {
+                uint64_t ticks = sim.stats.ticks.load(std::memory_order_relaxed);
+                double tps = (ticks - lastTitleTicks) / (now - lastTitleTime);
+                std::string title = "Falling Sand with Sliding - " + std::to_string((int)tps) + " ticks/s, "
+                    + std::to_string((int)(1000.0 / pacer.averageFrameMs() + 0.5)) + " fps"
+                    + " - brush: " + MATERIALS[brushMaterial].name
+                    + (pacer.turbo() ? " [TURBO]" : "");
+                glfwSetWindowTitle(window, title.c_str());
+                lastTitleTime = now;
+                lastTitleTicks = ticks;
+            }
+            if (opts.runForSeconds > 0.0 && now - startTime >= opts.runForSeconds)
+                glfwSetWindowShouldClose(window, true);
         }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        sim.stop();
+        if (capture) {
+            capture->finish();
+            reportCapture(*capture);
+        }
+        if (checkpointer) {
+            checkpointer->stop();
+            reportCheckpoints(*checkpointer);
+        }
+        finishInputLogs(opts, world, sim.replay, recorder);
     }
 
+    double elapsed = glfwGetTime() - startTime;
     glfwTerminate();
+    std::cout << "Simulation ticks: " << sim.stats.ticks.load()
+              << " (" << (uint64_t)(sim.stats.ticks.load() / elapsed) << " ticks/s)"
+              << ", snapshots published: " << sim.stats.published.load()
+              << ", dropped: " << sim.stats.dropped.load() << "\n";
+    std::cout << "Frames drawn: " << framesDrawn
+              << ", duplicated snapshots: " << framesDuplicated << "\n";
     std::cout << "Falling Sand with Sliding completed successfully!\n";
     return 0;
-}
\ No newline at end of file
+}
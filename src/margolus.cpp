@@ -0,0 +1,246 @@
+#include "margolus.h"
+#include "engine.h"
+#include "simulation.h"
+
+#include <algorithm>
+#include <utility>
+
+std::array<uint8_t, MAT_COUNT> buildMargolusClasses() {
+    std::array<uint8_t, MAT_COUNT> classes{};
+    for (int m = 0; m < MAT_COUNT; m++) {
+        switch (MATERIALS[m].behavior) {
+        case Behavior::None:   classes[m] = MARGOLUS_EMPTY; break;
+        case Behavior::Powder: classes[m] = MARGOLUS_POWDER; break;
+        case Behavior::Liquid: classes[m] = MARGOLUS_LIQUID; break;
+        case Behavior::Gas:    classes[m] = MARGOLUS_GAS; break;
+        default:               classes[m] = MARGOLUS_STATIC; break;
+        }
+    }
+    return classes;
+}
+
+// The rules, applied in order to a block; a cell moves at most once:
+//   1. a heavier class over a lighter one sinks through it (powder through
+//      liquid or gas, liquid through gas)
+//   2. powders and liquids fall into an empty cell below, gases rise into an
+//      empty cell above
+//   3. a powder or liquid resting on something slides diagonally down into
+//      an empty bottom cell; a gas held under something slides diagonally
+//      up into an empty top cell
+//   4. a liquid resting on something moves sideways into an empty
+//      neighbour, bottom row first; a gas held under something likewise,
+//      top row first
+std::array<uint8_t, MARGOLUS_PATTERNS> buildMargolusTable() {
+    std::array<uint8_t, MARGOLUS_PATTERNS> table{};
+    for (int pattern = 0; pattern < MARGOLUS_PATTERNS; pattern++) {
+        uint8_t cls[4], src[4] = { 0, 1, 2, 3 };
+        bool moved[4] = { false, false, false, false };
+        for (int i = 3, block = pattern >> 4; i >= 0; i--, block /= MARGOLUS_CLASSES)
+            cls[i] = (uint8_t)(block % MARGOLUS_CLASSES);
+        bool supported[2] = { (pattern & 1) != 0, (pattern & 2) != 0 };
+        bool capped[2] = { (pattern & 4) != 0, (pattern & 8) != 0 };
+
+        auto swapCells = [&](int a, int b) {
+            std::swap(cls[a], cls[b]);
+            std::swap(src[a], src[b]);
+            moved[a] = moved[b] = true;
+        };
+        auto moves = [&](int i) { return !moved[i] && (cls[i] == MARGOLUS_POWDER || cls[i] == MARGOLUS_LIQUID); };
+        auto rises = [&](int i) { return !moved[i] && cls[i] == MARGOLUS_GAS; };
+        auto weight = [](uint8_t c) {
+            return c == MARGOLUS_POWDER ? 3 : c == MARGOLUS_LIQUID ? 2 : c == MARGOLUS_GAS ? 1 : 0;
+        };
+
+        for (int col = 0; col < 2; col++)
+            if (weight(cls[col + 2]) > 0 && weight(cls[col]) > weight(cls[col + 2]))
+                swapCells(col, col + 2);
+        for (int col = 0; col < 2; col++) {
+            if (moves(col) && cls[col + 2] == MARGOLUS_EMPTY)
+                swapCells(col, col + 2);
+            else if (rises(col + 2) && cls[col] == MARGOLUS_EMPTY)
+                swapCells(col + 2, col);
+        }
+        for (int col = 0; col < 2; col++) {
+            int below = col + 2, diagonal = 3 - col;
+            if (moves(col) && cls[below] != MARGOLUS_EMPTY && cls[diagonal] == MARGOLUS_EMPTY)
+                swapCells(col, diagonal);
+        }
+        for (int col = 0; col < 2; col++) {
+            int cell = col + 2, above = col, diagonal = 1 - col;
+            if (rises(cell) && cls[above] != MARGOLUS_EMPTY && cls[diagonal] == MARGOLUS_EMPTY)
+                swapCells(cell, diagonal);
+        }
+
+        // Bottom row: resting means supported from below the block. Top
+        // row: a cell that didn't fall or slide is resting on the bottom row.
+        for (int col = 0; col < 2; col++) {
+            int cell = 2 + col, side = 3 - col;
+            if (!moved[cell] && cls[cell] == MARGOLUS_LIQUID && supported[col] && cls[side] == MARGOLUS_EMPTY) {
+                swapCells(cell, side);
+                break;
+            }
+        }
+        for (int col = 0; col < 2; col++) {
+            int cell = col, side = 1 - col;
+            if (!moved[cell] && cls[cell] == MARGOLUS_LIQUID && cls[side] == MARGOLUS_EMPTY) {
+                swapCells(cell, side);
+                break;
+            }
+        }
+        // Gases the other way up: the top row is held by the cap over the
+        // block, the bottom row by the top row
+        for (int col = 0; col < 2; col++) {
+            int cell = col, side = 1 - col;
+            if (rises(cell) && capped[col] && cls[side] == MARGOLUS_EMPTY) {
+                swapCells(cell, side);
+                break;
+            }
+        }
+        for (int col = 0; col < 2; col++) {
+            int cell = 2 + col, side = 3 - col;
+            if (rises(cell) && cls[side] == MARGOLUS_EMPTY) {
+                swapCells(cell, side);
+                break;
+            }
+        }
+
+        table[pattern] = (uint8_t)(src[0] | (src[1] << 2) | (src[2] << 4) | (src[3] << 6));
+    }
+    return table;
+}
+
+// ====================== Margolus Engine ======================
+class MargolusEngine : public SimulationEngine
+{
+public:
+    MargolusEngine() : classes(buildMargolusClasses()), table(buildMargolusTable()) {
+        for (int m = 0; m < MAT_COUNT; m++)
+            reactive[m] = World::reactionTable.reactive((uint8_t)m);
+    }
+
+    const char* name() const override { return "margolus"; }
+
+    uint32_t capabilities() const override { return ENGINE_GASES | ENGINE_DENSITY | ENGINE_DETERMINISTIC; }
+
+    void step(World& world, uint64_t tick) override;
+
+private:
+    static void reactBlock(World& world, int x, int y, uint64_t tick);
+
+    std::array<uint8_t, MAT_COUNT> classes;
+    std::array<uint8_t, MARGOLUS_PATTERNS> table;
+    std::array<uint8_t, MAT_COUNT> reactive;
+};
+
+// Whether a reaction with chance (out of REACTION_ROLLS) fires for the pair
+// of cells a, b of the block at (x, y) this tick: a hash of those rather
+// than a draw from the world's generator, so it doesn't depend on the
+// order blocks are visited in
+static bool reactionFires(int x, int y, int a, int b, uint64_t tick, uint16_t chance) {
+    uint64_t h = ((uint64_t)(uint32_t)x << 32 | (uint32_t)y) ^ (tick << 4 | (uint64_t)(a << 2 | b)) * 0x9e3779b97f4a7c15ull;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return (uint32_t)(h % REACTION_ROLLS) < chance;
+}
+
+// Reactions between neighbouring cells of the block (water on lava, fire
+// on oil...) from the world's reaction table, each cell in at most one
+// per tick. Blocks shift every tick, so over two ticks every pair of
+// neighbours shares a block.
+void MargolusEngine::reactBlock(World& world, int x, int y, uint64_t tick) {
+    static const int pairs[4][2] = { {2, 3}, {0, 1}, {0, 2}, {1, 3} };
+    const int px[4] = { x, x + 1, x, x + 1 };
+    const int py[4] = { y + 1, y + 1, y, y };
+    bool reacted[4] = { false, false, false, false };
+    for (const auto& pair : pairs) {
+        int a = pair[0], b = pair[1];
+        // half blocks at the world's edge (see step)
+        if (reacted[a] || reacted[b] || px[a] < 0 || px[b] >= world.gridWidth)
+            continue;
+        uint8_t self = world.cellAt(px[a], py[a]), other = world.cellAt(px[b], py[b]);
+        const Reaction& r = World::reactionTable.lookup(self, other);
+        if (r.chance == 0 || !reactionFires(x, y, a, b, tick, r.chance))
+            continue;
+        if (r.toOther != other)
+            world.transformCell(px[b], py[b], r.toOther);
+        if (r.toSelf != self)
+            world.transformCell(px[a], py[a], r.toSelf);
+        reacted[a] = reacted[b] = true;
+    }
+}
+
+// Blocks start on even cells one tick and odd cells the next. Each block
+// only rewrites its own four cells; block rows go top to bottom so the
+// support read from the row below is still this tick's starting state,
+// which makes the result independent of the order within a row. A block
+// row is taken 64 columns at a time: 64 empty cells across both its rows
+// are skipped with one occupancy check, otherwise the span is read from
+// each of the four rows the blocks look at.
+// A block holding more than one material, one of which reacts with
+// something, gets its reactions first and moves as they left it.
+void MargolusEngine::step(World& world, uint64_t tick) {
+    int width = world.gridWidth, height = world.gridHeight;
+    int offset = (int)(tick & 1);
+    if (height < offset + 2)
+        return;   // no block row fits this tick
+    int topBlockRow = offset + (height - 2 - offset) / 2 * 2;
+    uint8_t scratch[4][64];
+    for (int y = topBlockRow; y >= offset; y -= 2) {
+        bool hasUnder = y > 0, hasOver = y + 2 < height;
+        for (int start = offset; start + 1 < width; start += 64) {
+            if ((world.occupancyWindow(y, start) | world.occupancyWindow(y + 1, start)) == 0)
+                continue;
+            int n = std::min(64, width - start);
+            const uint8_t* bottom = world.rowSpan(y, start, n, scratch[0]);
+            const uint8_t* top = world.rowSpan(y + 1, start, n, scratch[1]);
+            const uint8_t* under = hasUnder ? world.rowSpan(y - 1, start, n, scratch[2]) : nullptr;
+            const uint8_t* over = hasOver ? world.rowSpan(y + 2, start, n, scratch[3]) : nullptr;
+            // Blocks only change their own columns, so what the spans show
+            // of the others stays current even once the chunk they were
+            // read from has been copied on write
+            for (int i = 0; i + 1 < n; i += 2) {
+                int x = start + i;
+                uint8_t a = top[i], b = top[i + 1], c = bottom[i], d = bottom[i + 1];
+                if ((b != a || c != a || d != a) && (reactive[a] | reactive[b] | reactive[c] | reactive[d])) {
+                    reactBlock(world, x, y, tick);
+                    a = world.cellAt(x, y + 1);
+                    b = world.cellAt(x + 1, y + 1);
+                    c = world.cellAt(x, y);
+                    d = world.cellAt(x + 1, y);
+                }
+                uint16_t pattern = margolusPattern(classes[a], classes[b], classes[c], classes[d],
+                                                   !under || under[i] != MAT_EMPTY, !under || under[i + 1] != MAT_EMPTY,
+                                                   !over || over[i] != MAT_EMPTY, !over || over[i + 1] != MAT_EMPTY);
+                uint8_t permutation = table[pattern];
+                if (permutation != MARGOLUS_IDENTITY)
+                    world.moveBlock(x, y, permutation);
+            }
+        }
+
+        // A column at either edge left out of this tick's blocks moves as
+        // half a block against the wall; otherwise nothing in it could ever
+        // cross this block row's boundary
+        auto cls = [&](int row, int x) {
+            return x >= 0 && x < width ? classes[world.cellAt(x, row)] : (uint8_t)MARGOLUS_STATIC;
+        };
+        auto occupied = [&](int row, int x) {
+            return row < 0 || row >= height || x < 0 || x >= width || world.cellAt(x, row) != MAT_EMPTY;
+        };
+        bool leftOut = offset == 1, rightOut = (width - offset) % 2 == 1;
+        for (int x : { -1, width - 1 }) {
+            if (!(x < 0 ? leftOut : rightOut))
+                continue;
+            reactBlock(world, x, y, tick);
+            uint16_t pattern = margolusPattern(cls(y + 1, x), cls(y + 1, x + 1), cls(y, x), cls(y, x + 1),
+                                               occupied(y - 1, x), occupied(y - 1, x + 1),
+                                               occupied(y + 2, x), occupied(y + 2, x + 1));
+            if (table[pattern] != MARGOLUS_IDENTITY)
+                world.moveBlock(x, y, table[pattern]);
+        }
+    }
+}
+
+std::unique_ptr<SimulationEngine> createMargolusEngine() {
+    return std::unique_ptr<SimulationEngine>(new MargolusEngine());
+}
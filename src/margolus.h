@@ -0,0 +1,64 @@
+#ifndef MARGOLUS_H
+#define MARGOLUS_H
+
+#include <array>
+#include <cstdint>
+
+#include "materials.h"
+
+// Margolus neighbourhood block automaton.
+//
+// The grid is cut into disjoint 2x2 blocks, shifted by one cell on every
+// other tick so movement crosses block borders. Each block is rewritten on
+// its own from its contents alone, so blocks never interfere: any order (or
+// any number of threads) gives the same, deterministic result.
+//
+// Cells are reduced to one of five classes, and the four classes of a block
+// plus two bits saying whether the cells under its bottom row are occupied
+// and two saying whether those over its top row are make a pattern. A table
+// built at startup maps each pattern to the permutation that moves the
+// block's cells. Materials (and everything else per cell) travel with the
+// permutation, so the table never sees them.
+//
+// The support and cap bits are the only reads outside the block. Blocks are
+// swept top to bottom, so the row below hasn't been rewritten yet and shows
+// the state at the start of the tick, and the row above has been rewritten
+// in full; either way a block row sees the same whatever its order.
+//
+// Block positions: 0 = top-left, 1 = top-right, 2 = bottom-left, 3 = bottom-right.
+enum MargolusClass : uint8_t {
+    MARGOLUS_EMPTY = 0,
+    MARGOLUS_POWDER,
+    MARGOLUS_LIQUID,
+    MARGOLUS_GAS,
+    MARGOLUS_STATIC,  // solids
+    MARGOLUS_CLASSES
+};
+
+// Permutation that leaves a block as it is: position i takes cell i
+const uint8_t MARGOLUS_IDENTITY = 0 | (1 << 2) | (2 << 4) | (3 << 6);
+
+// Source position of the cell that ends up at position i
+inline int margolusSource(uint8_t permutation, int i) { return (permutation >> (2 * i)) & 3; }
+
+// Five classes don't pack into bits, so the four make a base-5 number;
+// times 16 for the support and cap bits that's 10000 patterns, a 10 KB table
+const int MARGOLUS_PATTERNS = MARGOLUS_CLASSES * MARGOLUS_CLASSES * MARGOLUS_CLASSES * MARGOLUS_CLASSES * 16;
+
+// Block pattern from the classes of its four cells, the support under the
+// bottom row and the cap over the top row (true = occupied, or the edge of
+// the world)
+inline uint16_t margolusPattern(uint8_t topLeft, uint8_t topRight, uint8_t bottomLeft, uint8_t bottomRight,
+                                bool supportLeft, bool supportRight, bool capLeft, bool capRight)
+{
+    int block = ((topLeft * MARGOLUS_CLASSES + topRight) * MARGOLUS_CLASSES + bottomLeft) * MARGOLUS_CLASSES + bottomRight;
+    return (uint16_t)(block << 4 | supportLeft | supportRight << 1 | capLeft << 2 | capRight << 3);
+}
+
+// Class of every material
+std::array<uint8_t, MAT_COUNT> buildMargolusClasses();
+
+// Permutation for every block pattern
+std::array<uint8_t, MARGOLUS_PATTERNS> buildMargolusTable();
+
+#endif
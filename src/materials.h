@@ -0,0 +1,141 @@
+#ifndef MATERIALS_H
+#define MATERIALS_H
+
+#include <cstdint>
+#include <cstring>
+
+// ====================== Materials ======================
+// One byte per cell. The table below is the single place a material is
+// described; its update rule is generated from it at compile time.
+enum Material : uint8_t {
+    MAT_EMPTY = 0,
+    MAT_SAND,
+    MAT_WATER,
+    MAT_STONE,
+    MAT_GAS,
+    MAT_FIRE,
+    MAT_OIL,
+    MAT_SMOKE,
+    MAT_STEAM,
+    MAT_LAVA,
+    MAT_WOOD,
+    MAT_GLASS,
+    MAT_COUNT
+};
+
+const int MAX_MATERIALS = 16;   // size of the shader palette
+static_assert(MAT_COUNT <= MAX_MATERIALS, "grow the palette in the shaders and MAX_MATERIALS");
+
+// How a material moves; each is one branch of World::updateParticle
+enum class Behavior : uint8_t {
+    None,     // empty cells are never updated
+    Powder,   // falls, slides down diagonally, piles up
+    Liquid,   // falls, slides, flows sideways
+    Gas,      // rises, slides up diagonally, drifts sideways
+    Solid     // never moves
+};
+
+const int MAX_DISPERSION = 63;   // one occupancy word per sideways scan
+
+struct MaterialInfo {
+    const char* name;
+    Behavior behavior;
+    uint8_t dispersion;   // liquids / gases: max cells moved sideways per tick
+    uint8_t density;      // heavier materials sink through lighter non-solids
+    uint8_t lifeMin, lifeMax;   // ticks a cell lasts before turning into decaysTo; 0 = forever
+    uint8_t decaysTo;
+    float heat;           // temperature the cell holds its surroundings at; 0 = not a heat source
+    float changesAbove;   // melting / boiling / ignition point; 0 = never
+    uint8_t changesTo;
+    float r, g, b;        // base colour, varied per cell by the shade
+};
+
+// Fire burns in place (Solid: it never moves, so a burning cell costs no
+// particle) and leaves smoke behind; smoke fades, steam condenses. Fire and
+// lava heat their surroundings (see heat.h): water boils, gas and oil catch
+// fire, sand melts into glass.
+constexpr MaterialInfo MATERIALS[MAT_COUNT] = {
+    //  name     behavior          disp dens  life      decays to  heat     changes above
+    { "empty", Behavior::None,   0,   0,   0,   0, MAT_EMPTY,    0.0f,   0.0f, MAT_EMPTY, 0.00f, 0.00f, 0.00f },
+    { "sand",  Behavior::Powder, 0,  15,   0,   0, MAT_EMPTY,    0.0f, 900.0f, MAT_GLASS, 0.86f, 0.74f, 0.45f },
+    { "water", Behavior::Liquid, 8,  10,   0,   0, MAT_EMPTY,    0.0f, 100.0f, MAT_STEAM, 0.20f, 0.45f, 0.90f },
+    { "stone", Behavior::Solid,  0, 255,   0,   0, MAT_EMPTY,    0.0f,   0.0f, MAT_EMPTY, 0.50f, 0.50f, 0.53f },
+    { "gas",   Behavior::Gas,    4,   1,   0,   0, MAT_EMPTY,    0.0f, 150.0f, MAT_FIRE,  0.70f, 0.85f, 0.70f },
+    { "fire",  Behavior::Solid,  0, 255,  20,  60, MAT_SMOKE,  600.0f,   0.0f, MAT_EMPTY, 1.00f, 0.45f, 0.10f },
+    { "oil",   Behavior::Liquid, 6,   8,   0,   0, MAT_EMPTY,    0.0f, 250.0f, MAT_FIRE,  0.35f, 0.24f, 0.10f },
+    { "smoke", Behavior::Gas,    3,   1,  60, 180, MAT_EMPTY,    0.0f,   0.0f, MAT_EMPTY, 0.28f, 0.28f, 0.30f },
+    { "steam", Behavior::Gas,    5,   1, 120, 240, MAT_WATER,    0.0f,   0.0f, MAT_EMPTY, 0.82f, 0.84f, 0.90f },
+    { "lava",  Behavior::Liquid, 2,  20,   0,   0, MAT_EMPTY, 1100.0f,   0.0f, MAT_EMPTY, 1.00f, 0.30f, 0.05f },
+    { "wood",  Behavior::Solid,  0, 255,   0,   0, MAT_EMPTY,    0.0f, 300.0f, MAT_FIRE,  0.45f, 0.30f, 0.15f },
+    { "glass", Behavior::Solid,  0, 255,   0,   0, MAT_EMPTY,    0.0f,   0.0f, MAT_EMPTY, 0.70f, 0.85f, 0.85f },
+};
+
+constexpr bool dispersionInRange(int m = 0)
+{
+    return m == MAT_COUNT || (MATERIALS[m].dispersion <= MAX_DISPERSION && dispersionInRange(m + 1));
+}
+static_assert(dispersionInRange(), "dispersion is scanned within one 64-bit word");
+
+// A cell's remaining life has to count down to exactly zero
+constexpr bool lifetimesValid(int m = 0)
+{
+    return m == MAT_COUNT ||
+           (MATERIALS[m].lifeMin <= MATERIALS[m].lifeMax && (MATERIALS[m].lifeMax == 0 || MATERIALS[m].lifeMin > 0) &&
+            lifetimesValid(m + 1));
+}
+static_assert(lifetimesValid(), "lifetimes need 0 < lifeMin <= lifeMax, or both 0");
+
+// ------------------- Reactions -------------------
+// What happens when two materials touch: a becomes toA and b becomes toB,
+// with the given chance per check. Only active cells check their
+// neighbours (moving particles every tick, burning cells on a staggered
+// interval), through the dense table built from this list (reactions.h).
+struct ReactionRule {
+    uint8_t a, b;
+    uint8_t toA, toB;
+    float chance;
+};
+
+constexpr ReactionRule REACTIONS[] = {
+    //  a          b          a becomes  b becomes  chance
+    { MAT_WATER, MAT_LAVA,  MAT_STEAM, MAT_STONE, 0.50f },
+    { MAT_WATER, MAT_FIRE,  MAT_STEAM, MAT_SMOKE, 0.50f },
+    { MAT_FIRE,  MAT_WOOD,  MAT_FIRE,  MAT_FIRE,  0.10f },
+    { MAT_FIRE,  MAT_OIL,   MAT_FIRE,  MAT_FIRE,  0.40f },
+    { MAT_FIRE,  MAT_GAS,   MAT_FIRE,  MAT_FIRE,  0.60f },
+    { MAT_LAVA,  MAT_WOOD,  MAT_LAVA,  MAT_FIRE,  0.20f },
+    { MAT_LAVA,  MAT_OIL,   MAT_LAVA,  MAT_FIRE,  0.50f },
+    { MAT_LAVA,  MAT_SAND,  MAT_LAVA,  MAT_GLASS, 0.02f },
+};
+
+// Results are never empty: a cell can't tell whether a neighbour is in the
+// particle list, so reactions only ever change materials in place
+constexpr bool reactionsValid(size_t i = 0)
+{
+    return i == sizeof(REACTIONS) / sizeof(REACTIONS[0]) ||
+           (REACTIONS[i].a != REACTIONS[i].b && REACTIONS[i].a < MAT_COUNT && REACTIONS[i].b < MAT_COUNT &&
+            REACTIONS[i].toA != MAT_EMPTY && REACTIONS[i].toB != MAT_EMPTY && REACTIONS[i].toA < MAT_COUNT &&
+            REACTIONS[i].toB < MAT_COUNT && REACTIONS[i].chance > 0.0f && REACTIONS[i].chance <= 1.0f &&
+            reactionsValid(i + 1));
+}
+static_assert(reactionsValid(), "reactions need two different materials, non-empty results and 0 < chance <= 1");
+
+// Coolest temperature at which anything changes; regions of the heat field
+// below it are skipped when looking for cells to melt, boil or ignite
+constexpr float lowestChangeTemperature(int m = 1, float lowest = 1e30f)
+{
+    return m == MAT_COUNT ? lowest
+                          : lowestChangeTemperature(m + 1, MATERIALS[m].changesAbove > 0 && MATERIALS[m].changesAbove < lowest
+                                                               ? MATERIALS[m].changesAbove : lowest);
+}
+
+// MAT_COUNT if there is no material with that name
+inline Material materialByName(const char* name)
+{
+    for (int m = 1; m < MAT_COUNT; m++)
+        if (std::strcmp(MATERIALS[m].name, name) == 0)
+            return (Material)m;
+    return MAT_COUNT;
+}
+
+#endif
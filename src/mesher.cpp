@@ -0,0 +1,47 @@
+#include "mesher.h"
+
+#include <cstddef>
+
+void greedyMeshRegion(const uint8_t* material, const uint8_t* flags, uint8_t settledMask,
+                      int stride, int x0, int y0, int width, int height,
+                      std::vector<QuadData>& out) {
+    // covered[] marks cells already inside an emitted quad (region local)
+    static thread_local std::vector<uint8_t> covered;
+    covered.assign((size_t)width * height, 0);
+
+    auto meshable = [&](int lx, int ly, uint8_t mat) {
+        size_t cell = (size_t)ly * stride + lx;
+        return !covered[(size_t)ly * width + lx] && (flags[cell] & settledMask) && material[cell] == mat;
+    };
+
+    for (int ly = 0; ly < height; ly++) {
+        for (int lx = 0; lx < width; lx++) {
+            size_t cell = (size_t)ly * stride + lx;
+            if (covered[(size_t)ly * width + lx] || !(flags[cell] & settledMask))
+                continue;
+            uint8_t mat = material[cell];
+
+            // grow right
+            int w = 1;
+            while (lx + w < width && meshable(lx + w, ly, mat))
+                w++;
+
+            // grow up while the whole span matches
+            int h = 1;
+            for (; ly + h < height; h++) {
+                bool rowMatches = true;
+                for (int i = 0; i < w && rowMatches; i++)
+                    rowMatches = meshable(lx + i, ly + h, mat);
+                if (!rowMatches)
+                    break;
+            }
+
+            for (int j = 0; j < h; j++)
+                for (int i = 0; i < w; i++)
+                    covered[(size_t)(ly + j) * width + lx + i] = 1;
+
+            out.emplace_back(x0 + lx, y0 + ly, w, h, mat);
+            lx += w - 1;
+        }
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef MESHER_H
+#define MESHER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "snapshot.h"
+
+// Greedy mesher: covers the settled cells of one region with maximal
+// same-material rectangles. Grows each rectangle right as far as the row
+// allows, then up while every cell of the next row matches. O(cells).
+//
+// material/flags point at the region's bottom-left cell, rows stride apart;
+// a cell is meshed when (flags & settledMask) != 0. Quads are appended to
+// out, placed at (x0, y0) plus their offset in the region.
+void greedyMeshRegion(const uint8_t* material, const uint8_t* flags, uint8_t settledMask,
+                      int stride, int x0, int y0, int width, int height,
+                      std::vector<QuadData>& out);
+
+#endif
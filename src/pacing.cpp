@@ -0,0 +1,59 @@
+#include "pacing.h"
+
+#include <algorithm>
+#include <thread>
+
+FramePacer::FramePacer(const PacingSettings& s)
+    : settings(s),
+      lastFrame(clock::now()),
+      nextDeadline(clock::now()),
+      spinMarginMs(1.0),
+      avgFrameMs(0.0) {}
+
+void FramePacer::setTurbo(bool on) {
+    settings.turbo = on;
+    nextDeadline = clock::now();
+}
+
+double FramePacer::targetFps() const {
+    return settings.turbo ? settings.turboFps : settings.targetFps;
+}
+
+SimSpeed FramePacer::simSpeed() const {
+    return (settings.turbo || settings.uncapped) ? SimSpeed::Uncapped : SimSpeed::RealTime;
+}
+
+int FramePacer::swapInterval() const {
+    // In turbo the frame period is far longer than a refresh, vsync would only add latency
+    return (settings.vsync && !settings.turbo) ? 1 : 0;
+}
+
+void FramePacer::endFrame() {
+    auto now = clock::now();
+
+    if (swapInterval() == 0 && targetFps() > 0.0) {
+        auto period = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(1.0 / targetFps()));
+        nextDeadline += period;
+
+        // More than a whole frame late: re-anchor instead of bursting to catch up
+        if (now > nextDeadline + period)
+            nextDeadline = now + period;
+
+        // Coarse sleep, then spin; widen the margin when the sleep overshoots
+        auto sleepUntil = nextDeadline - std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double, std::milli>(spinMarginMs));
+        if (sleepUntil > now) {
+            std::this_thread::sleep_until(sleepUntil);
+            double overshootMs = std::chrono::duration<double, std::milli>(clock::now() - sleepUntil).count();
+            spinMarginMs = std::min(4.0, std::max(0.2, spinMarginMs * 0.9 + overshootMs * 0.2));
+        }
+        while (clock::now() < nextDeadline)
+            std::this_thread::yield();
+        now = clock::now();
+    }
+
+    double frameMs = std::chrono::duration<double, std::milli>(now - lastFrame).count();
+    avgFrameMs = (avgFrameMs == 0.0) ? frameMs : avgFrameMs * 0.9 + frameMs * 0.1;
+    lastFrame = now;
+}
@@ -0,0 +1,52 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <chrono>
+
+// How fast the simulation thread is allowed to tick.
+enum class SimSpeed {
+    RealTime,   // fixed TICK_RATE ticks per second
+    Uncapped    // tick back-to-back, publish a snapshot only when the renderer wants one
+};
+
+struct PacingSettings {
+    double targetFps = 60.0;
+    double turboFps = 5.0;   // display rate while fast-forwarding
+    bool vsync = false;      // let the swap chain pace instead of the controller
+    bool uncapped = false;   // uncapped simulation at the normal display rate
+    bool turbo = false;      // uncapped simulation + low display rate
+};
+
+// Render-side pacing controller. It decides the swap interval and the
+// simulation speed, and holds each frame to the target period by sleeping
+// for most of the remaining budget and spinning for the last sliver. The
+// spin margin adapts to how late the OS actually wakes us up.
+class FramePacer
+{
+public:
+    explicit FramePacer(const PacingSettings& settings);
+
+    void setTurbo(bool on);
+    bool turbo() const { return settings.turbo; }
+
+    double targetFps() const;
+    SimSpeed simSpeed() const;
+    int swapInterval() const;
+
+    // Call after swapping buffers; blocks until the next frame is due.
+    void endFrame();
+
+    // exponential moving average of the frame period actually achieved
+    double averageFrameMs() const { return avgFrameMs; }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    PacingSettings settings;
+    clock::time_point lastFrame;
+    clock::time_point nextDeadline;
+    double spinMarginMs;
+    double avgFrameMs;
+};
+
+#endif
@@ -0,0 +1,351 @@
+#include "paged_world.h"
+#include "heat.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+PagedWorldFile::PagedWorldFile()
+    : base(nullptr), size(0), current(nullptr), table(nullptr), chunksAcross(0), chunksDown(0)
+#ifdef _WIN32
+      , fileHandle(nullptr), mappingHandle(nullptr)
+#endif
+{}
+
+PagedWorldFile::~PagedWorldFile() {
+    close();
+}
+
+bool PagedWorldFile::open(const std::string& path) {
+    close();
+    auto fail = [&](const char* why) {
+        std::cerr << "Failed to open " << path << ": " << why << "\n";
+        close();
+        return false;
+    };
+
+#ifdef _WIN32
+    // Sharing delete lets a checkpoint replace the file while it is mapped
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return fail("cannot open file");
+    fileHandle = file;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(PagedWorldHeader))
+        return fail("not a paged world file");
+    size = (size_t)fileSize.QuadPart;
+    mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mappingHandle)
+        return fail("cannot map file");
+    base = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (!base)
+        return fail("cannot map file");
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return fail("cannot open file");
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(PagedWorldHeader)) {
+        ::close(fd);
+        return fail("not a paged world file");
+    }
+    size = (size_t)info.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);    // the mapping keeps the file alive
+    if (mapping == MAP_FAILED)
+        return fail("cannot map file");
+    base = (const uint8_t*)mapping;
+#endif
+
+    // Every update leaves the file whole pages long
+    if (size % PAGED_WORLD_PAGE != 0)
+        return fail("truncated file");
+
+    // The valid slot with the higher sequence is the current state; with
+    // neither valid, slot 0 explains why
+    const char* why = "not a paged world file";
+    const PagedWorldHeader* slots[2] = { (const PagedWorldHeader*)base, nullptr };
+    if (size >= PAGED_WORLD_HEADER_SLOT + sizeof(PagedWorldHeader))
+        slots[1] = (const PagedWorldHeader*)(base + PAGED_WORLD_HEADER_SLOT);
+    for (int i = 0; i < 2; i++) {
+        if (!slots[i])
+            continue;
+        const char* error = check(*slots[i]);
+        if (i == 0)
+            why = error;
+        if (!error && (!current || slots[i]->sequence > current->sequence))
+            current = slots[i];
+    }
+    if (!current)
+        return fail(why);
+    const PagedWorldHeader& h = *current;
+    chunksAcross = (int)((h.width + h.chunkSize - 1) / h.chunkSize);
+    chunksDown = (int)((h.height + h.chunkSize - 1) / h.chunkSize);
+    table = (const PagedChunkEntry*)(base + h.tableOffset);
+    return true;
+}
+
+// Why header h can't be used, or nullptr. Its table, every chunk and the
+// extra section must lie inside the file, page-aligned, so nothing read
+// through it can go past the mapping.
+const char* PagedWorldFile::check(const PagedWorldHeader& h) const {
+    if (!isPagedWorldMagic(h.magic))
+        return "not a paged world file";
+    if (h.version != PAGED_WORLD_VERSION)
+        return "unsupported version";
+    if (h.checksum != pagedHeaderChecksum(h))
+        return "damaged header";
+    if (h.width < 1 || h.height < 1 || h.chunkSize < 1 || h.heatScale < 1 || h.chunkSize % h.heatScale != 0 ||
+        h.materialCount > PAGED_WORLD_MATERIALS)
+        return "bad header";
+    uint64_t chunks = (uint64_t)((h.width + h.chunkSize - 1) / h.chunkSize) * ((h.height + h.chunkSize - 1) / h.chunkSize);
+    uint64_t tableBytes = chunks * sizeof(PagedChunkEntry);
+    if (h.tableOffset < PAGED_WORLD_PAGE || h.tableOffset % PAGED_WORLD_PAGE != 0 || h.tableOffset > size ||
+        tableBytes > size - h.tableOffset)
+        return "bad chunk table";
+    if (h.chunkBytes != pagedChunkBytes((int)h.chunkSize, (int)h.heatScale))
+        return "bad chunk size";
+    const PagedChunkEntry* entries = (const PagedChunkEntry*)(base + h.tableOffset);
+    for (uint64_t i = 0; i < chunks; i++) {
+        uint64_t offset = entries[i].offset;
+        if (offset && (offset < PAGED_WORLD_PAGE || offset % PAGED_WORLD_PAGE != 0 || offset > size ||
+                       h.chunkBytes > size - offset))
+            return "chunk outside the file";
+    }
+    if (h.extraOffset > size || h.extraBytes > size - h.extraOffset)
+        return "truncated file";
+    return nullptr;
+}
+
+void PagedWorldFile::close() {
+#ifdef _WIN32
+    if (base)
+        UnmapViewOfFile(base);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (fileHandle)
+        CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (base)
+        munmap((void*)base, size);
+#endif
+    base = nullptr;
+    size = 0;
+    current = nullptr;
+    table = nullptr;
+    chunksAcross = chunksDown = 0;
+}
+
+void PagedWorldFile::evict(int cx, int cy) const {
+    uint64_t offset = entry(cx, cy).offset;
+    if (!offset)
+        return;
+#ifdef _WIN32
+    // Unlocking pages that aren't locked just trims them from the working set
+    VirtualUnlock((LPVOID)(base + offset), (SIZE_T)header().chunkBytes);
+#else
+    // Private read-only mapping: the pages are clean, so this just drops them
+    madvise((void*)(base + offset), header().chunkBytes, MADV_DONTNEED);
+#endif
+}
+
+// ------------------- Writer -------------------
+static uint64_t wholePages(uint64_t bytes) {
+    return (bytes + PAGED_WORLD_PAGE - 1) / PAGED_WORLD_PAGE * PAGED_WORLD_PAGE;
+}
+
+// Rename from over to; a file already at to is replaced in one step
+static bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+PagedWorldWriter::PagedWorldWriter()
+    : file(nullptr), fileWidth(0), fileHeight(0), chunkSize(0), heatScale(0), chunkBytes(0), fileEnd(0),
+      sequence(0), tableOffset(0), tableBytes(0), extraOffset(0), extraBytes(0) {}
+
+PagedWorldWriter::~PagedWorldWriter() {
+    close();
+}
+
+bool PagedWorldWriter::create(const std::string& target, int width, int height, int size, int scale) {
+    close();
+    path = target;
+    tempPath = target + ".tmp";
+    file = std::fopen(tempPath.c_str(), "w+b");
+    if (!file) {
+        std::cerr << "Failed to open " << tempPath << " for writing\n";
+        return false;
+    }
+    fileWidth = width;
+    fileHeight = height;
+    chunkSize = size;
+    heatScale = scale;
+    size_t chunks = (size_t)((width + size - 1) / size) * ((height + size - 1) / size);
+    table.assign(chunks, PagedChunkEntry());
+    committed = table;
+    chunkBytes = pagedChunkBytes(size, scale);
+    fileEnd = PAGED_WORLD_PAGE;     // the header slots
+    sequence = 0;
+    tableOffset = tableBytes = extraOffset = extraBytes = 0;
+    freeSpace.clear();
+    released.clear();
+    return true;
+}
+
+void PagedWorldWriter::close() {
+    if (file) {
+        std::fclose(file);
+        if (!tempPath.empty())
+            std::remove(tempPath.c_str());
+    }
+    file = nullptr;
+    tempPath.clear();
+    fileWidth = fileHeight = 0;
+}
+
+bool PagedWorldWriter::writeAt(uint64_t offset, const void* data, size_t size) {
+#ifdef _WIN32
+    bool sought = _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    bool sought = fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+    return sought && std::fwrite(data, 1, size, file) == size;
+}
+
+// Everything written so far is on the disk, not just handed to the OS
+bool PagedWorldWriter::sync() {
+    if (std::fflush(file) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// First free extent that fits, or the end of the file
+uint64_t PagedWorldWriter::allocate(uint64_t bytes) {
+    for (auto it = freeSpace.begin(); it != freeSpace.end(); ++it) {
+        if (it->second < bytes)
+            continue;
+        uint64_t offset = it->first, left = it->second - bytes;
+        freeSpace.erase(it);
+        if (left)
+            freeSpace[offset + bytes] = left;
+        return offset;
+    }
+    uint64_t offset = fileEnd;
+    fileEnd += bytes;
+    return offset;
+}
+
+// Give an extent back, merged with free neighbours
+void PagedWorldWriter::release(uint64_t offset, uint64_t bytes) {
+    auto next = freeSpace.lower_bound(offset);
+    if (next != freeSpace.end() && next->first == offset + bytes) {
+        bytes += next->second;
+        next = freeSpace.erase(next);
+    }
+    if (next != freeSpace.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += bytes;
+            return;
+        }
+    }
+    freeSpace[offset] = bytes;
+}
+
+bool PagedWorldWriter::writeChunk(size_t index, const uint8_t* data) {
+    PagedChunkEntry& entry = table[index];
+    if (entry.offset)
+        released.emplace_back(entry.offset, chunkBytes);
+    entry.offset = data ? allocate(chunkBytes) : 0;
+    return !data || writeAt(entry.offset, data, chunkBytes);
+}
+
+bool PagedWorldWriter::finish(const PagedWorldHeader& fields, const PagedChunkEntry* chunkInfo,
+                              const std::vector<uint8_t>& extra) {
+    for (size_t i = 0; i < table.size(); i++) {
+        uint64_t offset = table[i].offset;
+        table[i] = chunkInfo[i];
+        table[i].offset = offset;
+    }
+    uint64_t newTableBytes = wholePages(table.size() * sizeof(PagedChunkEntry));
+    uint64_t newExtraBytes = wholePages(extra.size());
+    uint64_t newTable = allocate(newTableBytes), newExtra = allocate(newExtraBytes);
+
+    PagedWorldHeader header = fields;
+    std::memcpy(header.magic, PAGED_WORLD_MAGIC, sizeof(header.magic));
+    header.version = PAGED_WORLD_VERSION;
+    header.width = (uint32_t)fileWidth;
+    header.height = (uint32_t)fileHeight;
+    header.chunkSize = (uint32_t)chunkSize;
+    header.heatScale = (uint32_t)heatScale;
+    header.tableOffset = newTable;
+    header.chunkBytes = chunkBytes;
+    header.extraOffset = newExtra;
+    header.extraBytes = extra.size();
+    header.sequence = sequence + 1;
+    header.reserved = 0;
+    header.checksum = pagedHeaderChecksum(header);
+
+    // The chunks, table and extra section are on the disk before the header
+    // that points at them goes into the slot the previous update isn't in.
+    // Page-multiple extents are written in full so the file ends on a page.
+    std::vector<uint8_t> padded(extra);
+    padded.resize(newExtraBytes, 0);
+    std::vector<PagedChunkEntry> paddedTable(table);
+    paddedTable.resize(newTableBytes / sizeof(PagedChunkEntry), PagedChunkEntry());
+    bool ok = writeAt(newExtra, padded.data(), padded.size()) &&
+              writeAt(newTable, paddedTable.data(), newTableBytes) && sync();
+    ok = ok && writeAt(header.sequence % 2 ? 0 : PAGED_WORLD_HEADER_SLOT, &header, sizeof(header)) && sync();
+    if (!ok)
+        return false;
+    if (!tempPath.empty()) {
+        // First update: the new file replaces whatever was at path
+        std::fclose(file);
+        file = nullptr;
+        if (!replaceFile(tempPath, path) || !(file = std::fopen(path.c_str(), "r+b"))) {
+            std::cerr << "Failed to replace " << path << "\n";
+            std::remove(tempPath.c_str());
+            tempPath.clear();
+            return false;
+        }
+        tempPath.clear();
+    }
+
+    // What the previous state used and this one doesn't is free from now on
+    sequence = header.sequence;
+    if (tableBytes)
+        release(tableOffset, tableBytes);
+    if (extraBytes)
+        release(extraOffset, extraBytes);
+    for (const auto& extent : released)
+        release(extent.first, extent.second);
+    released.clear();
+    tableOffset = newTable;
+    tableBytes = newTableBytes;
+    extraOffset = newExtra;
+    extraBytes = newExtraBytes;
+    committed = table;
+    return true;
+}
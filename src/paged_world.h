@@ -0,0 +1,205 @@
+#ifndef PAGED_WORLD_H
+#define PAGED_WORLD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ====================== Paged World Files ======================
+// World file laid out chunk-major for memory mapping: every stored chunk is
+// a page-aligned block holding its material, flag and lifetime planes and
+// its heat region, uncompressed in the same layout the world uses. A chunk
+// table gives each chunk's offset, or 0 for a chunk that was empty and
+// cold, which takes no space at all.
+//
+//   0, 2048        PagedWorldHeader slots
+//   tableOffset    PagedChunkEntry per chunk, row-major
+//   each offset    cells[cs*cs], flags[cs*cs], lifetime[cs*cs], heat[hs*hs]
+//                  (cs = chunkSize, hs = chunkSize / heatScale), padded to
+//                  whole pages
+//   extraOffset    u32 length + random generator state, u32 count + particles
+//
+// An update writes its chunks, table and extra section to space the current
+// state doesn't use, then its header to the other slot with the next
+// sequence number; a header only counts if its checksum matches. Whatever
+// point a crash stops an update at, the slot with the higher valid sequence
+// describes a complete state.
+//
+// Opening maps the file and only checks the headers and table, whatever the
+// world's size; chunks are faulted in by the OS as they are read and can be
+// dropped from memory again with evict(). The table's per-chunk counts let
+// a world use its chunks straight from the mapping without reading them
+// first.
+const char* const PAGED_WORLD_EXTENSION = ".sandpage";   // World::save picks this format by name
+const char PAGED_WORLD_MAGIC[8] = { 'S', 'A', 'N', 'D', 'P', 'A', 'G', 'E' };
+const uint32_t PAGED_WORLD_VERSION = 3;
+const size_t PAGED_WORLD_PAGE = 4096;       // alignment of the table and of every chunk
+const size_t PAGED_WORLD_HEADER_SLOT = 2048;    // offset of the second header
+const int PAGED_WORLD_NAME = 16;            // bytes per material name, NUL padded
+const int PAGED_WORLD_MATERIALS = 16;
+
+struct PagedWorldHeader {
+    char magic[8];                  // PAGED_WORLD_MAGIC
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t chunkSize, heatScale;
+    uint32_t flags;                 // same bits as the RLE world file
+    uint64_t tick;
+    float spawnAccumulator;
+    uint32_t materialCount;
+    char materials[PAGED_WORLD_MATERIALS][PAGED_WORLD_NAME];
+    uint64_t tableOffset;
+    uint64_t chunkBytes;            // stride of a stored chunk, whole pages
+    uint64_t extraOffset;
+    uint64_t extraBytes;
+    uint64_t sequence;              // one more per update
+    uint32_t checksum;              // pagedHeaderChecksum
+    uint32_t reserved;
+};
+static_assert(sizeof(PagedWorldHeader) == 352, "PagedWorldHeader is part of the file format");
+
+struct PagedChunkEntry {
+    uint64_t offset;                // 0 = empty chunk at ambient temperature
+    uint8_t heatAwake, heatHot;     // the chunk's heat region flags
+    uint16_t heatSources;           // cells of heat-emitting materials
+    uint16_t agingCells;            // cells with a lifetime running
+    uint8_t reserved[2];
+};
+static_assert(sizeof(PagedChunkEntry) == 16, "PagedChunkEntry is part of the file format");
+
+inline bool isPagedWorldMagic(const char* magic) {
+    return std::memcmp(magic, PAGED_WORLD_MAGIC, sizeof(PAGED_WORLD_MAGIC)) == 0;
+}
+
+// FNV-1a over the header with its checksum field zeroed
+inline uint32_t pagedHeaderChecksum(const PagedWorldHeader& header) {
+    PagedWorldHeader copy = header;
+    copy.checksum = 0;
+    const uint8_t* bytes = (const uint8_t*)&copy;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(copy); i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+// Bytes one chunk takes on disk, rounded up to whole pages
+inline uint64_t pagedChunkBytes(int chunkSize, int heatScale) {
+    int heatSide = chunkSize / heatScale;
+    uint64_t bytes = 3ull * chunkSize * chunkSize + sizeof(float) * (uint64_t)heatSide * heatSide;
+    return (bytes + PAGED_WORLD_PAGE - 1) / PAGED_WORLD_PAGE * PAGED_WORLD_PAGE;
+}
+
+// Read-only mapping of a paged world file
+class PagedWorldFile
+{
+public:
+    PagedWorldFile();
+    ~PagedWorldFile();
+    PagedWorldFile(const PagedWorldFile&) = delete;
+    PagedWorldFile& operator=(const PagedWorldFile&) = delete;
+
+    // Map path and validate the current header and its chunk table. Prints
+    // the reason and returns false on failure.
+    bool open(const std::string& path);
+    void close();
+
+    const PagedWorldHeader& header() const { return *current; }
+    int chunksX() const { return chunksAcross; }
+    int chunksY() const { return chunksDown; }
+
+    const PagedChunkEntry& entry(int cx, int cy) const { return table[(size_t)cy * chunksAcross + cx]; }
+
+    // Planes of a stored chunk, straight from the mapping; nullptr for an
+    // empty one. Rows are chunkSize apart, the bottom row first.
+    const uint8_t* chunkCells(int cx, int cy) const { return chunkData(cx, cy, 0); }
+    const uint8_t* chunkFlags(int cx, int cy) const { return chunkData(cx, cy, 1); }
+    const uint8_t* chunkLifetime(int cx, int cy) const { return chunkData(cx, cy, 2); }
+    const float* chunkHeat(int cx, int cy) const { return (const float*)chunkData(cx, cy, 3); }
+
+    // The section after the chunks (random state and particles)
+    const uint8_t* extra() const { return base + header().extraOffset; }
+
+    // Tell the OS the chunk's pages aren't needed any more; it drops them
+    // and reads them back from the file if they are touched again
+    void evict(int cx, int cy) const;
+
+private:
+    const char* check(const PagedWorldHeader& header) const;
+    const uint8_t* chunkData(int cx, int cy, int plane) const {
+        uint64_t offset = entry(cx, cy).offset;
+        if (!offset)
+            return nullptr;
+        size_t planeBytes = (size_t)header().chunkSize * header().chunkSize;
+        return base + offset + plane * planeBytes;
+    }
+
+    const uint8_t* base;
+    size_t size;
+    const PagedWorldHeader* current;    // the slot in use
+    const PagedChunkEntry* table;
+    int chunksAcross, chunksDown;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+// Writes a paged world file and keeps it open for updating, so a
+// checkpoint only has to write what changed since the last one. Each update
+// goes to space the committed state doesn't use and is committed by
+// finish(); space that state no longer refers to afterwards is reused by
+// later updates.
+class PagedWorldWriter
+{
+public:
+    PagedWorldWriter();
+    ~PagedWorldWriter();
+    PagedWorldWriter(const PagedWorldWriter&) = delete;
+    PagedWorldWriter& operator=(const PagedWorldWriter&) = delete;
+
+    // Start a new file for a world of width x height, every chunk empty.
+    // It is written next to path and only replaces it once the first
+    // finish() is done, so a file already there (the last good checkpoint,
+    // or a world mapped from it) is left alone until then. Prints the reason
+    // and returns false on failure.
+    bool create(const std::string& path, int width, int height, int chunkSize, int heatScale);
+
+    // Stop writing; a file that never got its first finish() is removed
+    void close();
+
+    // Open for a world of this size and layout
+    bool isOpenFor(int width, int height) const { return file && fileWidth == width && fileHeight == height; }
+
+    // Store chunk index (row-major). data holds chunkBytes in the file's
+    // chunk layout; nullptr marks a blank chunk, which takes no space.
+    bool writeChunk(size_t index, const uint8_t* data);
+
+    // Commit the update: chunkInfo has every chunk's table entry but the
+    // offset (heat flags and counts), extra is the random state and particle
+    // section. header supplies the world fields (tick, flags, materials, ...);
+    // the layout fields are filled in here.
+    bool finish(const PagedWorldHeader& header, const PagedChunkEntry* chunkInfo, const std::vector<uint8_t>& extra);
+
+private:
+    bool writeAt(uint64_t offset, const void* data, size_t size);
+    bool sync();
+    uint64_t allocate(uint64_t bytes);
+    void release(uint64_t offset, uint64_t bytes);
+
+    FILE* file;
+    std::string path, tempPath;     // tempPath until the first finish()
+    int fileWidth, fileHeight, chunkSize, heatScale;
+    uint64_t chunkBytes, fileEnd, sequence;
+    std::vector<PagedChunkEntry> table;         // the update being written
+    std::vector<PagedChunkEntry> committed;     // what the current header refers to
+    uint64_t tableOffset, tableBytes, extraOffset, extraBytes;  // committed
+    std::map<uint64_t, uint64_t> freeSpace;     // offset -> bytes, page multiples
+    std::vector<std::pair<uint64_t, uint64_t>> released;  // free once this update is committed
+};
+
+#endif
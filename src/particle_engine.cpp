@@ -0,0 +1,65 @@
+#include "engine.h"
+#include "simulation.h"
+
+#include <algorithm>
+
+// ====================== Particle Engine ======================
+// The reference engine: every moving cell is a particle, updated once per
+// tick through the per-material rule table (fall, slide, disperse, rise).
+// Resting cells sleep in the grid until a neighbour wakes them.
+class ParticleEngine : public SimulationEngine
+{
+public:
+    const char* name() const override { return "particles"; }
+
+    uint32_t capabilities() const override {
+        return ENGINE_PARTICLES | ENGINE_VELOCITY | ENGINE_GASES | ENGINE_DENSITY;
+    }
+
+    void step(World& world, uint64_t tick) override;
+};
+
+void ParticleEngine::step(World& world, uint64_t) {
+    auto& particles = world.particles;
+
+    // Particles of cells that burnt out are dropped before anything can move
+    // into those cells and be mistaken for them
+    if (world.staleParticles) {
+        particles.erase(std::remove_if(particles.begin(), particles.end(),
+                                       [&](const Particle& p) {
+                                           return world.cellAt(p.x, p.y) == MAT_EMPTY;
+                                       }),
+                        particles.end());
+        world.staleParticles = false;
+    }
+
+    // Particles woken during the step are appended and wait for the next tick
+    size_t count = particles.size();
+    size_t settledCount = 0;
+    for (size_t i = count; i-- > 0;) {
+        Particle& p = particles[i];
+        p.material = world.cellAt(p.x, p.y);   // may have decayed or reacted into something else
+        if (World::reactionTable.reactive(p.material)) {
+            world.react(p.x, p.y);
+            p.material = world.cellAt(p.x, p.y);
+        }
+        if (!World::updateTable[p.material](world, p)) {
+            world.settle(p);
+            p.material = MAT_EMPTY;   // removal mark; the cell keeps the material
+            settledCount++;
+        }
+    }
+
+    // Drop the settled ones, keeping the update order of the rest stable. A
+    // particle that settled and was woken again in the same tick has already
+    // been re-added as a new entry.
+    if (settledCount > 0) {
+        particles.erase(std::remove_if(particles.begin(), particles.end(),
+                                       [](const Particle& p) { return p.material == MAT_EMPTY; }),
+                        particles.end());
+    }
+}
+
+std::unique_ptr<SimulationEngine> createParticleEngine() {
+    return std::unique_ptr<SimulationEngine>(new ParticleEngine());
+}
@@ -0,0 +1,19 @@
+#include "reactions.h"
+
+#include <cmath>
+#include <iostream>
+
+ReactionTable::ReactionTable()
+    : pairs{}, anyReaction{}
+{
+    for (const ReactionRule& rule : REACTIONS) {
+        Reaction& forward = pairs[rule.a][rule.b];
+        if (forward.chance != 0)
+            std::cerr << "Duplicate reaction " << MATERIALS[rule.a].name << " + " << MATERIALS[rule.b].name
+                      << ", the later rule wins\n";
+        uint16_t chance = (uint16_t)std::lround(rule.chance * REACTION_ROLLS);
+        forward = { rule.toA, rule.toB, chance };
+        pairs[rule.b][rule.a] = { rule.toB, rule.toA, chance };
+        anyReaction[rule.a] = anyReaction[rule.b] = true;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef REACTIONS_H
+#define REACTIONS_H
+
+#include <cstdint>
+
+#include "materials.h"
+
+// What a cell of one material does to a neighbour of another
+struct Reaction {
+    uint8_t toSelf, toOther;
+    uint16_t chance;   // out of REACTION_ROLLS; 0 = the pair doesn't react
+};
+
+const int REACTION_ROLLS = 65535;
+
+// Dense [material][material] lookup of the REACTIONS list, built once at
+// startup with both orders of every pair filled in. Checking a neighbour is
+// one indexed read however many rules there are; pairs without a rule
+// (including a material and itself, or empty) read chance 0.
+class ReactionTable
+{
+public:
+    ReactionTable();
+
+    const Reaction& lookup(uint8_t self, uint8_t other) const { return pairs[self][other]; }
+
+    // false for materials that react with nothing, so their cells skip the check
+    bool reactive(uint8_t material) const { return anyReaction[material]; }
+
+private:
+    Reaction pairs[MAT_COUNT][MAT_COUNT];
+    bool anyReaction[MAT_COUNT];
+};
+
+#endif
@@ -0,0 +1,316 @@
+#include "renderer.h"
+#include "lod.h"
+#include "materials.h"
+#include "shader_sources.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+// Material colours never change, so both programs get them once
+static void setPalette(unsigned int program) {
+    float palette[MAX_MATERIALS * 3] = {};
+    for (int m = 0; m < MAT_COUNT; m++) {
+        palette[m * 3 + 0] = MATERIALS[m].r;
+        palette[m * 3 + 1] = MATERIALS[m].g;
+        palette[m * 3 + 2] = MATERIALS[m].b;
+    }
+    glUniform3fv(glGetUniformLocation(program, "palette"), MAX_MATERIALS, palette);
+}
+
+Renderer::Renderer()
+    : shader(loadShaderSources("test.vert", "test.frag")), lodShader(loadShaderSources("lod.vert", "lod.frag")),
+      instanceCapacity(0), staticChunksX(0),
+      drawnInstances(0), drawnQuads(0), drawnChunks(0), staticUploads(0),
+      lodTexture(0), lodTexWidth(0), lodTexHeight(0), maxTextureSize(0), lodTooLargeWarned(false),
+      drawnLodLevel(-1)
+{
+    viewProjLoc = glGetUniformLocation(shader.ID, "viewProj");
+
+    lodViewProjLoc = glGetUniformLocation(lodShader.ID, "viewProj");
+    lodRectLoc = glGetUniformLocation(lodShader.ID, "rect");
+    lodLevelLoc = glGetUniformLocation(lodShader.ID, "level");
+    lodShader.use();
+    glUniform1i(glGetUniformLocation(lodShader.ID, "cells"), 0);
+    setPalette(lodShader.ID);
+    shader.use();
+    setPalette(shader.ID);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+    // Square vertices
+    float vertices[] = {
+        0.5f,  0.5f, 0.0f,
+        0.5f, -0.5f, 0.0f,
+       -0.5f, -0.5f, 0.0f,
+       -0.5f,  0.5f, 0.0f
+    };
+
+    unsigned int indices[] = { 0, 1, 3, 1, 2, 3 };
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    glBindVertexArray(VAO);
+
+    // Vertex buffer
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+    // Element buffer
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    // Vertex attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // Interleaved instance buffer: packed grid cell + material/shade, read as integers
+    glGenBuffers(1, &instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glVertexAttribIPointer(1, 3, GL_UNSIGNED_SHORT, sizeof(InstanceData), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    // location 2 (quad size) stays disabled here; its generic value is set to 1x1 before drawing
+
+    // LOD VAO: just the square, stretched over the visible rect by the shader
+    glGenVertexArrays(1, &lodVAO);
+    glBindVertexArray(lodVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+    glBindVertexArray(0);
+}
+
+Renderer::~Renderer() {
+    releaseStaticChunks();
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &instanceVBO);
+    glDeleteVertexArrays(1, &lodVAO);
+    if (lodTexture)
+        glDeleteTextures(1, &lodTexture);
+    glDeleteProgram(shader.ID);
+    glDeleteProgram(lodShader.ID);
+}
+
+void Renderer::releaseStaticChunks() {
+    for (auto& chunk : staticChunks) {
+        if (!chunk.vao) continue;
+        glDeleteVertexArrays(1, &chunk.vao);
+        glDeleteBuffers(1, &chunk.vbo);
+    }
+    staticChunks.clear();
+}
+
+// ------------------- Static Layer -------------------
+void Renderer::updateStaticChunk(StaticChunk& chunk, const ChunkMesh* mesh) {
+    uint64_t version = mesh ? mesh->version : 0;
+    if (chunk.version == version)
+        return;
+    chunk.version = version;
+    chunk.count = mesh ? (unsigned int)mesh->quads.size() : 0;
+    if (chunk.count == 0)
+        return;
+
+    if (!chunk.vao) {
+        // Same unit square as the particles, instance = merged rectangle of settled cells
+        glGenVertexArrays(1, &chunk.vao);
+        glGenBuffers(1, &chunk.vbo);
+        glBindVertexArray(chunk.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+        glVertexAttribIPointer(1, 3, GL_UNSIGNED_SHORT, sizeof(QuadData), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(1, 1);
+        glVertexAttribIPointer(2, 2, GL_UNSIGNED_BYTE, sizeof(QuadData), (void*)offsetof(QuadData, w));
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(2, 1);
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+    glBufferData(GL_ARRAY_BUFFER, chunk.count * sizeof(QuadData), mesh->quads.data(), GL_STATIC_DRAW);
+    staticUploads++;
+}
+
+// ------------------- Dynamic Layer -------------------
+unsigned int Renderer::uploadVisibleInstances(const RenderSnapshot& snapshot, const ChunkRect& rect) {
+    const std::vector<uint32_t>& offsets = snapshot.chunkOffsets;
+
+    // Each visible chunk row is one contiguous range
+    unsigned int count = 0;
+    for (int cy = rect.cy0; cy <= rect.cy1; cy++) {
+        int first = cy * snapshot.chunksX;
+        count += offsets[first + rect.cx1 + 1] - offsets[first + rect.cx0];
+    }
+    if (count == 0) return 0;
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    if (count > instanceCapacity)
+        instanceCapacity = count * 2;
+    // orphan the previous contents so we never wait on last frame's draw
+    glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+    unsigned int uploaded = 0;
+    for (int cy = rect.cy0; cy <= rect.cy1; cy++) {
+        int first = cy * snapshot.chunksX;
+        uint32_t begin = offsets[first + rect.cx0];
+        uint32_t end = offsets[first + rect.cx1 + 1];
+        if (end == begin) continue;
+        glBufferSubData(GL_ARRAY_BUFFER, uploaded * sizeof(InstanceData), (end - begin) * sizeof(InstanceData),
+                        snapshot.instances.data() + begin);
+        uploaded += end - begin;
+    }
+    return count;
+}
+
+// ------------------- LOD Layer -------------------
+bool Renderer::ensureLodTexture(const RenderSnapshot& snapshot) {
+    // Padded to whole chunks so every tile level lands on exact texel bounds
+    int width = snapshot.chunksX * snapshot.chunkSize;
+    int height = snapshot.chunksY * snapshot.chunkSize;
+    if (width > maxTextureSize || height > maxTextureSize) {
+        if (!lodTooLargeWarned)
+            std::cerr << "World is larger than GL_MAX_TEXTURE_SIZE (" << maxTextureSize
+                      << "), LOD rendering disabled\n";
+        lodTooLargeWarned = true;
+        return false;
+    }
+    if (lodTexture && width == lodTexWidth && height == lodTexHeight)
+        return true;
+
+    if (!lodTexture)
+        glGenTextures(1, &lodTexture);
+    glBindTexture(GL_TEXTURE_2D, lodTexture);
+    for (int level = 0; level < snapshot.lodLevels; level++)
+        glTexImage2D(GL_TEXTURE_2D, level, GL_R8UI, width >> level, height >> level, 0,
+                     GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+    // Integer textures only allow nearest filtering; the shader uses texelFetch anyway
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, snapshot.lodLevels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    lodTexWidth = width;
+    lodTexHeight = height;
+    lodVersions.assign(snapshot.lodChunks.size(), 0);
+    return true;
+}
+
+bool Renderer::drawLod(const RenderSnapshot& snapshot, const Camera& camera) {
+    if (!ensureLodTexture(snapshot))
+        return false;
+    if (lodVersions.size() != snapshot.lodChunks.size())
+        lodVersions.assign(snapshot.lodChunks.size(), 0);
+
+    // Upload the tiles that changed since we last saw them, every level
+    glBindTexture(GL_TEXTURE_2D, lodTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t c = 0; c < snapshot.lodChunks.size(); c++) {
+        const ChunkLod* tile = snapshot.lodChunks[c].get();
+        if (!tile || tile->version == lodVersions[c])
+            continue;
+        int cx = (int)(c % snapshot.chunksX), cy = (int)(c / snapshot.chunksX);
+        for (int level = 0; level < snapshot.lodLevels; level++) {
+            int side = snapshot.chunkSize >> level;
+            glTexSubImage2D(GL_TEXTURE_2D, level, cx * side, cy * side, side, side, GL_RED_INTEGER,
+                            GL_UNSIGNED_BYTE, tile->texels.data() + lodLevelOffset(snapshot.chunkSize, level));
+        }
+        lodVersions[c] = tile->version;
+        staticUploads++;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // Coarsest level whose texels are still at least a pixel
+    int level = (int)std::floor(std::log2(1.0f / camera.zoom));
+    drawnLodLevel = std::max(0, std::min(snapshot.lodLevels - 1, level));
+
+    float minX, minY, maxX, maxY;
+    camera.visibleRect(minX, minY, maxX, maxY);
+    minX = std::max(minX, 0.0f);
+    minY = std::max(minY, 0.0f);
+    maxX = std::min(maxX, (float)snapshot.gridWidth);
+    maxY = std::min(maxY, (float)snapshot.gridHeight);
+
+    float viewProj[9];
+    camera.viewProjection(viewProj);
+    lodShader.use();
+    glUniformMatrix3fv(lodViewProjLoc, 1, GL_FALSE, viewProj);
+    glUniform4f(lodRectLoc, minX, minY, maxX, maxY);
+    glUniform1i(lodLevelLoc, drawnLodLevel);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, lodTexture);
+    glBindVertexArray(lodVAO);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    return true;
+}
+
+void Renderer::draw(const RenderSnapshot& snapshot, const Camera& camera) {
+    drawnInstances = 0;
+    drawnQuads = 0;
+    drawnChunks = 0;
+    staticUploads = 0;
+    drawnLodLevel = -1;
+    if (snapshot.chunksX == 0) return;
+
+    // A different grid layout invalidates every cached chunk
+    size_t chunkCount = (size_t)snapshot.chunksX * snapshot.chunksY;
+    if (staticChunksX != snapshot.chunksX || staticChunks.size() != chunkCount) {
+        releaseStaticChunks();
+        staticChunks.resize(chunkCount);
+        staticChunksX = snapshot.chunksX;
+    }
+
+    // ------------------- Cull Chunks Against The View -------------------
+    float minX, minY, maxX, maxY;
+    camera.visibleRect(minX, minY, maxX, maxY);
+    ChunkRect rect;
+    rect.cx0 = std::max(0, (int)std::floor(minX / snapshot.chunkSize));
+    rect.cy0 = std::max(0, (int)std::floor(minY / snapshot.chunkSize));
+    rect.cx1 = std::min(snapshot.chunksX - 1, (int)std::floor(maxX / snapshot.chunkSize));
+    rect.cy1 = std::min(snapshot.chunksY - 1, (int)std::floor(maxY / snapshot.chunkSize));
+    if (rect.cx0 > rect.cx1 || rect.cy0 > rect.cy1) return;
+    drawnChunks = (rect.cx1 - rect.cx0 + 1) * (rect.cy1 - rect.cy0 + 1);
+
+    if (camera.zoom < LOD_MAX_ZOOM && !snapshot.lodChunks.empty() && drawLod(snapshot, camera))
+        return;
+
+    // ------------------- Update Layers -------------------
+    for (int cy = rect.cy0; cy <= rect.cy1; cy++) {
+        for (int cx = rect.cx0; cx <= rect.cx1; cx++) {
+            size_t c = (size_t)cy * snapshot.chunksX + cx;
+            updateStaticChunk(staticChunks[c], snapshot.staticChunks[c].get());
+            drawnQuads += staticChunks[c].count;
+        }
+    }
+    drawnInstances = uploadVisibleInstances(snapshot, rect);
+    if (drawnQuads == 0 && drawnInstances == 0) return;
+
+    // ------------------- Draw -------------------
+    float viewProj[9];
+    camera.viewProjection(viewProj);
+    shader.use();
+    glUniformMatrix3fv(viewProjLoc, 1, GL_FALSE, viewProj);
+
+    for (int cy = rect.cy0; cy <= rect.cy1 && drawnQuads > 0; cy++) {
+        for (int cx = rect.cx0; cx <= rect.cx1; cx++) {
+            const StaticChunk& chunk = staticChunks[(size_t)cy * snapshot.chunksX + cx];
+            if (chunk.count == 0) continue;
+            glBindVertexArray(chunk.vao);
+            glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, chunk.count);
+        }
+    }
+    if (drawnInstances > 0) {
+        glBindVertexArray(VAO);
+        glVertexAttribI4ui(2, 1, 1, 0, 0);   // particles are always one cell
+        glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, drawnInstances);
+    }
+}
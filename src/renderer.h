@@ -0,0 +1,83 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "camera.h"
+#include "shader.h"
+#include "snapshot.h"
+
+// Below this zoom (framebuffer pixels per cell) cells are smaller than
+// pixels and the LOD pyramid replaces quads and instances
+const float LOD_MAX_ZOOM = 1.0f;
+
+// Owns the GL objects for drawing a snapshot, in two layers through the same
+// shader:
+//   static   settled cells as merged quads, one GPU buffer per chunk, only
+//            re-uploaded when the chunk's mesh version changes
+//   dynamic  moving particles as instanced cells, streamed every frame
+// When zoomed out past LOD_MAX_ZOOM (and the snapshot carries the pyramid)
+// both are replaced by a single quad sampling an integer texture whose mip
+// levels are the LOD pyramid, at the level where a texel is about a pixel.
+// That costs one fetch per covered pixel however large the world is.
+// Must be created and used on the thread that owns the GL context.
+class Renderer
+{
+public:
+    Renderer();
+    ~Renderer();
+
+    // Bring the visible static chunks up to date, stream the visible
+    // instances and draw both into the current framebuffer
+    void draw(const RenderSnapshot& snapshot, const Camera& camera);
+
+    // Stats of the last draw(): instances streamed, quads drawn, chunks
+    // visible, and static chunks that had to be re-uploaded
+    unsigned int lastInstanceCount() const { return drawnInstances; }
+    unsigned int lastQuadCount() const { return drawnQuads; }
+    unsigned int lastChunkCount() const { return drawnChunks; }
+    unsigned int lastStaticUploadCount() const { return staticUploads; }
+    int lastLodLevel() const { return drawnLodLevel; }   // -1 when the LOD path wasn't used
+
+private:
+    struct ChunkRect { int cx0, cy0, cx1, cy1; };
+
+    // GPU copy of one chunk's settled-cell mesh, created the first time the
+    // chunk is visible with something in it
+    struct StaticChunk {
+        unsigned int vao = 0, vbo = 0;
+        uint64_t version = 0;    // ChunkMesh::version currently in vbo
+        unsigned int count = 0;
+    };
+
+    // Upload the instances of the visible chunk rows; returns the count
+    unsigned int uploadVisibleInstances(const RenderSnapshot& snapshot, const ChunkRect& rect);
+    void updateStaticChunk(StaticChunk& chunk, const ChunkMesh* mesh);
+    void releaseStaticChunks();
+
+    // LOD path; false if the pyramid doesn't fit in a texture
+    bool drawLod(const RenderSnapshot& snapshot, const Camera& camera);
+    bool ensureLodTexture(const RenderSnapshot& snapshot);
+
+    Shader shader;
+    Shader lodShader;
+    unsigned int VAO, VBO, EBO;
+    unsigned int lodVAO;
+    unsigned int instanceVBO;
+    unsigned int instanceCapacity;
+    std::vector<StaticChunk> staticChunks;
+    int staticChunksX;
+    unsigned int drawnInstances, drawnQuads, drawnChunks, staticUploads;
+    int viewProjLoc;
+
+    unsigned int lodTexture;
+    int lodTexWidth, lodTexHeight;
+    std::vector<uint64_t> lodVersions;   // ChunkLod::version uploaded per chunk
+    int maxTextureSize;
+    bool lodTooLargeWarned;
+    int drawnLodLevel;
+    int lodViewProjLoc, lodRectLoc, lodLevelLoc;
+};
+
+#endif
@@ -4,14 +4,31 @@
 #include <glad/glad.h>
 
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <filesystem>
+
+// GLSL source text for one program, already in memory
+struct ShaderSources {
+    std::string vertex;
+    std::string fragment;
+};
 
 class Shader
 {
 public:
     unsigned int ID;
+    // constructor builds the program from in-memory sources (no file I/O)
+    // ------------------------------------------------------------------------
+    explicit Shader(const ShaderSources& sources)
+    {
+        build(sources.vertex, sources.fragment);
+    }
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath)
@@ -47,9 +64,46 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
         }
+        // 2. build the program
+        build(vertexCode, fragmentCode);
+    }
+    // activate the shader
+    // ------------------------------------------------------------------------
+    void use() 
+    { 
+        glUseProgram(ID); 
+    }
+    // utility uniform functions
+    // ------------------------------------------------------------------------
+    void setBool(const std::string &name, bool value) const
+    {         
+        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+    }
+    // ------------------------------------------------------------------------
+    void setInt(const std::string &name, int value) const
+    { 
+        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+    }
+    // ------------------------------------------------------------------------
+    void setFloat(const std::string &name, float value) const
+    { 
+        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+    }
+
+private:
+    // reuse a cached program binary if we have one, otherwise build from source
+    // ------------------------------------------------------------------------
+    void build(const std::string& vertexCode, const std::string& fragmentCode)
+    {
+        if (!loadCachedProgram(vertexCode, fragmentCode))
+            compileProgram(vertexCode, fragmentCode);
+    }
+    // compile and link from source, then store the binary in the cache
+    // ------------------------------------------------------------------------
+    void compileProgram(const std::string& vertexCode, const std::string& fragmentCode)
+    {
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -65,36 +119,114 @@ public:
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
+        if (binaryCacheSupported())
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        storeCachedProgram(vertexCode, fragmentCode);
     }
-    // activate the shader
+    // program binaries need GL 4.1 / ARB_get_program_binary and at least one format
     // ------------------------------------------------------------------------
-    void use() 
-    { 
-        glUseProgram(ID); 
+    static bool binaryCacheSupported()
+    {
+        if (!glProgramBinary || !glGetProgramBinary || !glProgramParameteri)
+            return false;
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
     }
-    // utility uniform functions
+    // cache file for this source pair on this driver: 64-bit FNV-1a over the
+    // sources plus vendor/renderer/version, so a driver update misses cleanly
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
-    {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+    static std::filesystem::path cachePath(const std::string& vertexCode, const std::string& fragmentCode)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const char* data, size_t len) {
+            for (size_t i = 0; i < len; i++) {
+                hash ^= (unsigned char)data[i];
+                hash *= 1099511628211ull;
+            }
+            hash ^= 0xff; // separator so "ab"+"c" != "a"+"bc"
+            hash *= 1099511628211ull;
+        };
+        mix(vertexCode.data(), vertexCode.size());
+        mix(fragmentCode.data(), fragmentCode.size());
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            const char* str = (const char*)glGetString(name);
+            if (str) mix(str, std::char_traits<char>::length(str));
+        }
+        char fileName[32];
+        std::snprintf(fileName, sizeof(fileName), "%016llx.bin", (unsigned long long)hash);
+
+        const char* dir = std::getenv("SAND_SHADER_CACHE");
+        return std::filesystem::path(dir ? dir : "shader_cache") / fileName;
     }
+    // try glProgramBinary with a cached blob; false on a miss or if the driver rejects it
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
-    { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+    bool loadCachedProgram(const std::string& vertexCode, const std::string& fragmentCode)
+    {
+        if (!binaryCacheSupported())
+            return false;
+        std::ifstream file(cachePath(vertexCode, fragmentCode), std::ios::binary);
+        if (!file)
+            return false;
+        uint32_t format = 0;
+        if (!file.read((char*)&format, sizeof(format)))
+            return false;
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (binary.empty())
+            return false;
+
+        ID = glCreateProgram();
+        glProgramBinary(ID, format, binary.data(), (GLsizei)binary.size());
+        int success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success) {
+            // stale or foreign binary; caller falls back to compiling
+            glDeleteProgram(ID);
+            ID = 0;
+            return false;
+        }
+        return true;
     }
+    // write the linked program's binary; written to a temp file first so a
+    // concurrent start never sees a half-written entry
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
-    { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
-    }
+    void storeCachedProgram(const std::string& vertexCode, const std::string& fragmentCode)
+    {
+        int success = 0, length = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success || !binaryCacheSupported())
+            return;
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(ID, length, &length, &format, binary.data());
 
-private:
+        std::filesystem::path path = cachePath(vertexCode, fragmentCode);
+        std::filesystem::path tmp = path;
+        tmp += ".tmp";
+        std::error_code ec;
+        std::filesystem::create_directories(path.parent_path(), ec);
+        {
+            std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+            if (!file)
+                return;
+            uint32_t format32 = format;
+            file.write((const char*)&format32, sizeof(format32));
+            file.write(binary.data(), length);
+            if (!file)
+                return;
+        }
+        std::filesystem::rename(tmp, path, ec);
+        if (ec)
+            std::filesystem::remove(tmp, ec);
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
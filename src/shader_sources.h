@@ -0,0 +1,64 @@
+#ifndef SHADER_SOURCES_H
+#define SHADER_SOURCES_H
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "shader.h"
+
+// The CMake build generates embedded_shaders.h with every src/*.vert and
+// src/*.frag as constexpr string data. Builds without it (e.g. the manual
+// g++ one-liner) fall back to reading the files from the working directory.
+#if __has_include("embedded_shaders.h")
+#include "embedded_shaders.h"
+#define SAND_HAS_EMBEDDED_SHADERS 1
+#endif
+
+// read a whole file; empty string if it can't be opened
+inline std::string readShaderFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return std::string();
+    std::stringstream stream;
+    stream << file.rdbuf();
+    return stream.str();
+}
+
+// GLSL source for a shader by file name (e.g. "test.vert"). When
+// SAND_SHADER_DIR is set, a file of that name in the directory wins so
+// shaders can be edited without rebuilding; otherwise the embedded copy is
+// used and startup touches no files.
+inline std::string loadShaderSource(const char* name)
+{
+    if (const char* dir = std::getenv("SAND_SHADER_DIR")) {
+        std::string source = readShaderFile(std::string(dir) + "/" + name);
+        if (!source.empty())
+            return source;
+        std::cerr << "SAND_SHADER_DIR: " << name << " not found in " << dir << ", using built-in copy\n";
+    }
+#ifdef SAND_HAS_EMBEDDED_SHADERS
+    for (const auto& entry : embedded_shaders::ENTRIES) {
+        if (std::strcmp(entry.name, name) == 0)
+            return std::string(entry.source, entry.size);
+    }
+    std::cout << "ERROR::SHADER::NOT_EMBEDDED: " << name << std::endl;
+    return std::string();
+#else
+    std::string source = readShaderFile(name);
+    if (source.empty())
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << name << std::endl;
+    return source;
+#endif
+}
+
+inline ShaderSources loadShaderSources(const char* vertexName, const char* fragmentName)
+{
+    return ShaderSources{ loadShaderSource(vertexName), loadShaderSource(fragmentName) };
+}
+
+#endif
@@ -0,0 +1,947 @@
+#include "simulation.h"
+#include "checkpoint.h"
+#include "input_log.h"
+#include "lod.h"
+#include "margolus.h"
+#include "mesher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// Mesh / LOD tile versions are unique across worlds so a renderer never
+// mistakes one world's chunk for another's
+static std::atomic<uint64_t> nextMeshVersion{1};
+
+static inline int countTrailingZeros(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    return _BitScanForward64(&index, v) ? (int)index : 64;
+#else
+    return v ? __builtin_ctzll(v) : 64;
+#endif
+}
+
+static inline int countLeadingZeros(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    return _BitScanReverse64(&index, v) ? 63 - (int)index : 64;
+#else
+    return v ? __builtin_clzll(v) : 64;
+#endif
+}
+
+// Shared by every chunk that is all empty and never changed
+alignas(64) static const uint8_t blankPlanes[3 * CHUNK_CELLS] = {};
+
+// ====================== World ======================
+World::World(int width, int height)
+    : World(width, height, std::random_device{}()) {}
+
+World::World(int width, int height, uint32_t seed)
+    : gridWidth(std::max(1, std::min(MAX_GRID_SIZE, width))),
+      gridHeight(std::max(1, std::min(MAX_GRID_SIZE, height))),
+      chunkColumns((gridWidth + CHUNK_SIZE - 1) / CHUNK_SIZE),
+      activeEngine(EngineRegistry::instance().create("auto")),
+      engineUsesParticles((activeEngine->capabilities() & ENGINE_PARTICLES) != 0),
+      evictCursor(0),
+      staleParticles(false),
+      heat((gridWidth + HEAT_SCALE - 1) / HEAT_SCALE, (gridHeight + HEAT_SCALE - 1) / HEAT_SCALE,
+           CHUNK_SIZE / HEAT_SCALE, lowestChangeTemperature()),
+      tickCount(0),
+      spawnAccumulator(0.0f),
+      gen(seed),
+      slideDir(0, 1),
+      shadeDist(0, 255),
+      changeChance(0, 3),
+      reactionRoll(0, REACTION_ROLLS - 1)
+{
+    particles.reserve(MAX_PARTICLES);
+    chunkMeshes.resize((size_t)chunksX() * chunksY());
+    chunkPlanes.assign(chunkMeshes.size(), blankPlanes);
+    ownedChunks.resize(chunkMeshes.size());
+    chunkChangedAt.assign(chunkMeshes.size(), 0);
+    meshDirty.assign(chunkMeshes.size(), 0);
+    lodTiles.resize(chunkMeshes.size());
+    lodDirty.assign(chunkMeshes.size(), 1);
+    agingCells.assign(chunkMeshes.size(), 0);
+    heatSources.assign(chunkMeshes.size(), 0);
+    checkpointDirty.assign(chunkMeshes.size(), 0);     // a fresh world is what an empty checkpoint holds
+    capturePending.assign(chunkMeshes.size(), 0);
+    captureEntry.assign(chunkMeshes.size(), -1);
+    checkpointDeadline = 0;
+    checkpointFrozen = false;
+    checkpointCopyNs = 0;
+}
+
+// ------------------- Chunk Storage -------------------
+// Occupancy bits past the world's right edge in chunk column cx
+static uint64_t edgeBits(int gridWidth, int cx) {
+    int width = gridWidth - cx * CHUNK_SIZE;
+    return width < CHUNK_SIZE ? ~0ull << width : 0;
+}
+
+World::OwnedChunk& World::ownChunk(size_t chunk) {
+    const uint8_t* planes = chunkData(chunk);
+    if (ownedChunks[chunk])
+        return *ownedChunks[chunk];     // paging in already made a copy
+    OwnedChunk* owned = new OwnedChunk;
+    std::memcpy(owned->planes, planes, sizeof(owned->planes));
+    uint64_t edge = edgeBits(gridWidth, (int)(chunk % chunkColumns));
+    for (int y = 0; y < CHUNK_SIZE; y++)
+        owned->occupancy[y] = (planes == blankPlanes ? 0 : rowOccupancy(planes + y * CHUNK_SIZE)) | edge;
+    ownedChunks[chunk].reset(owned);
+    chunkPlanes[chunk] = owned->planes;
+    return *owned;
+}
+
+// First read of a chunk of the paged file the world was loaded from: its
+// planes straight from the mapping when the file's material ids are ours,
+// otherwise a copy with the ids translated (an id the file doesn't list
+// reads as empty)
+const uint8_t* World::pageIn(size_t chunk) const {
+    const PagedSource& source = *pagedSource;
+    int cx = (int)(chunk % chunkColumns), cy = (int)(chunk / chunkColumns);
+    const uint8_t* planes = source.file.chunkCells(cx, cy);
+    uint8_t invalid = 0;
+    for (int i = 0; i < CHUNK_CELLS; i++)
+        invalid |= planes[i] >= source.materialCount;
+    if (source.identity && !invalid) {
+        chunkPlanes[chunk] = planes;
+        mappedChunks.push_back((uint32_t)chunk);
+        return planes;
+    }
+    if (invalid)
+        std::cerr << "Bad cell data in paged chunk (" << cx << ", " << cy << "), read as empty\n";
+    OwnedChunk* owned = new OwnedChunk;
+    for (int i = 0; i < CHUNK_CELLS; i++)
+        owned->planes[i] = planes[i] < source.materialCount ? source.remap[planes[i]] : (uint8_t)MAT_EMPTY;
+    std::memcpy(owned->planes + CHUNK_CELLS, planes + CHUNK_CELLS, 2 * CHUNK_CELLS);
+    uint64_t edge = edgeBits(gridWidth, cx);
+    for (int y = 0; y < CHUNK_SIZE; y++)
+        owned->occupancy[y] = rowOccupancy(owned->planes + y * CHUNK_SIZE) | edge;
+    ownedChunks[chunk].reset(owned);
+    chunkPlanes[chunk] = owned->planes;
+    source.file.evict(cx, cy);
+    return owned->planes;
+}
+
+// occupancyWord of a chunk without its own copy, worked out from its cells
+uint64_t World::sharedOccupancy(size_t chunk, int y) const {
+    const uint8_t* planes = chunkData(chunk);
+    uint64_t edge = edgeBits(gridWidth, (int)(chunk % chunkColumns));
+    return planes == blankPlanes ? edge : rowOccupancy(planes + (y & (CHUNK_SIZE - 1)) * CHUNK_SIZE) | edge;
+}
+
+// Cells [x, x + count) of row y, all inside the world, from plane 0
+// (materials), 1 (flags) or 2 (lifetimes)
+void World::copyRow(int y, int x, int count, uint8_t* out, int plane) const {
+    while (count > 0) {
+        int span = std::min(count, CHUNK_SIZE - (x & (CHUNK_SIZE - 1)));
+        std::memcpy(out, chunkData(chunkIndex(x, y)) + plane * CHUNK_CELLS + cellOffset(x, y), span);
+        out += span;
+        x += span;
+        count -= span;
+    }
+}
+
+// Materials of cells [x, x + count) of row y: straight from the chunk when
+// they are all in one, otherwise copied into scratch
+const uint8_t* World::rowSpan(int y, int x, int count, uint8_t* scratch) const {
+    if ((x & (CHUNK_SIZE - 1)) + count <= CHUNK_SIZE)
+        return chunkData(chunkIndex(x, y)) + cellOffset(x, y);
+    copyRow(y, x, count, scratch);
+    return scratch;
+}
+
+// Look at a few mapped chunks a tick; one with no change in it or next to
+// it for PAGE_EVICT_TICKS (and no heat moving or hot enough to be scanned)
+// has its pages handed back, and is read from the file again when next
+// needed. An engine without particles reads every occupied cell every
+// tick, so under one nothing would stay evicted.
+void World::evictSleepingChunks() {
+    if (!pagedSource || !engineUsesParticles)
+        return;
+    int cy = chunksY();
+    for (int n = 0; n < PAGE_EVICT_CHECKS && !mappedChunks.empty(); n++) {
+        if (evictCursor >= mappedChunks.size())
+            evictCursor = 0;
+        uint32_t chunk = mappedChunks[evictCursor];
+        int x = (int)(chunk % chunkColumns), y = (int)(chunk / chunkColumns);
+        bool sleeping = !heat.regionAwake(chunk) && !heat.regionHot(chunk);
+        for (int j = std::max(y - 1, 0); j <= std::min(y + 1, cy - 1) && sleeping; j++)
+            for (int i = std::max(x - 1, 0); i <= std::min(x + 1, chunkColumns - 1) && sleeping; i++)
+                sleeping = tickCount - chunkChangedAt[(size_t)j * chunkColumns + i] >= (uint64_t)PAGE_EVICT_TICKS;
+        if (!sleeping) {
+            evictCursor++;
+            continue;
+        }
+        pagedSource->file.evict(x, y);
+        if (!ownedChunks[chunk])
+            chunkPlanes[chunk] = nullptr;
+        mappedChunks[evictCursor] = mappedChunks.back();
+        mappedChunks.pop_back();
+    }
+}
+
+// Check if a grid position is valid and empty
+bool World::isValidAndEmpty(int x, int y) const {
+    return x >= 0 && x < gridWidth && y >= 0 && y < gridHeight && cellAt(x, y) == MAT_EMPTY;
+}
+
+bool World::spawnNear(int gridX, int gridY, uint8_t material) {
+    int searchRadius = 3;
+
+    for (int dy = 0; dy <= searchRadius; dy++) {
+        for (int dx = -dy; dx <= dy; dx++) {
+            int checkX = gridX + dx;
+            int checkY = gridY + dy;
+
+            for (int yOffset : {0, -dy}) {
+                if (yOffset != 0 && dy == 0) continue;
+                int finalY = checkY + yOffset;
+
+                if (particles.size() >= MAX_PARTICLES)
+                    return false;
+
+                if (isValidAndEmpty(checkX, finalY)) {
+                    setCell(checkX, finalY, material);
+                    startLifetime(checkX, finalY, material);
+                    if (MATERIALS[material].behavior == Behavior::Solid || !engineUsesParticles) {
+                        setSettled(checkX, finalY, true);
+                    } else {
+                        particles.emplace_back(checkX, finalY, material, (uint8_t)shadeDist(gen));
+                    }
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void World::applyInput(bool spawning, int gridX, int gridY, uint8_t material) {
+    if (!spawning) {
+        spawnAccumulator = 0.0f;
+        return;
+    }
+    spawnAccumulator += SPAWN_RATE / TICK_RATE;
+    while (spawnAccumulator >= 1.0f) {
+        spawnNear(gridX, gridY, material);
+        spawnAccumulator -= 1.0f;
+    }
+}
+
+// ====================== Update Rules ======================
+// One instantiation per material; if constexpr strips every branch that
+// doesn't apply, so sand's rule is exactly fall-then-slide.
+template <Material M>
+bool World::updateParticle(World& world, Particle& p) {
+    constexpr Behavior behavior = MATERIALS[M].behavior;
+
+    if constexpr (behavior == Behavior::Powder) {
+        return world.fall(p) || world.tryEnter(p, p.x, p.y - 1, -1) || world.trySlide(p, -1);
+    } else if constexpr (behavior == Behavior::Liquid) {
+        return world.fall(p) || world.tryEnter(p, p.x, p.y - 1, -1) || world.trySlide(p, -1) ||
+               world.tryDisperse(p, -1, MATERIALS[M].dispersion);
+    } else if constexpr (behavior == Behavior::Gas) {
+        return world.tryEnter(p, p.x, p.y + 1, 1) || world.trySlide(p, 1) ||
+               world.tryDisperse(p, 1, MATERIALS[M].dispersion);
+    } else if constexpr (behavior == Behavior::Solid) {
+        return false;
+    } else {
+        return true;   // empty: never in the particle list
+    }
+}
+
+// Jump table indexed by material id, filled from the material enum
+template <size_t... I>
+constexpr std::array<World::UpdateFn, sizeof...(I)> World::makeUpdateTable(std::index_sequence<I...>) {
+    return {{ &World::updateParticle<(Material)I>... }};
+}
+
+const std::array<World::UpdateFn, MAT_COUNT> World::updateTable =
+    World::makeUpdateTable(std::make_index_sequence<MAT_COUNT>{});
+
+const ReactionTable World::reactionTable;
+
+// What a particle of material moving vertically by dy finds at (x, y).
+// Only resting cells can be displaced: a moving one is somewhere in the
+// particle list with no cheap way to find it, so it blocks for now and the
+// heavier cell is woken again once it settles (see settle()).
+World::Entry World::entryAt(int x, int y, uint8_t material, int dy) const {
+    if (x < 0 || x >= gridWidth || y < 0 || y >= gridHeight)
+        return Entry::Blocked;
+    const uint8_t* planes = chunkData(chunkIndex(x, y));
+    size_t offset = cellOffset(x, y);
+    uint8_t other = planes[offset];
+    if (other == MAT_EMPTY)
+        return Entry::Free;
+    if (!(planes[CHUNK_CELLS + offset] & CELL_SETTLED) || MATERIALS[other].behavior == Behavior::Solid)
+        return Entry::Blocked;
+    bool sinks = dy < 0 ? MATERIALS[material].density > MATERIALS[other].density
+                        : MATERIALS[material].density < MATERIALS[other].density;
+    return sinks ? Entry::Displace : Entry::Blocked;
+}
+
+// Move into (x, y) if it's free, or swap with a lighter (heavier for
+// upward movers) resting cell there
+bool World::tryEnter(Particle& p, int x, int y, int dy) {
+    switch (entryAt(x, y, p.material, dy)) {
+    case Entry::Free:
+        moveParticle(p, x, y);
+        return true;
+    case Entry::Displace:
+        displace(p, x, y);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Free fall with velocity. Gravity accelerates the particle, then it walks
+// the grid cells along its velocity vector (Amanatides-Woo DDA, so it never
+// cuts a corner between two occupied cells) and stops in front of the first
+// occupied one. A tall drop takes a handful of ticks instead of one tick per
+// cell. Returns false, with the velocity cleared, if the cell below is not
+// free; the caller then tries displacing and sliding.
+bool World::fall(Particle& p) {
+    if (!isValidAndEmpty(p.x, p.y - 1)) {
+        p.vx = 0.0f;
+        p.vy = 0.0f;
+        return false;
+    }
+    p.vy = std::min(std::max(p.vy, 1.0f) + GRAVITY, MAX_FALL_SPEED);
+    p.vx *= AIR_DRAG;
+
+    // Cell-centre origin; t runs from 0 to 1 over this tick's displacement
+    float dx = p.vx, dy = -p.vy;
+    const float inf = std::numeric_limits<float>::infinity();
+    int stepX = dx > 0 ? 1 : -1, stepY = dy > 0 ? 1 : -1;
+    float tDeltaX = dx != 0 ? 1.0f / std::fabs(dx) : inf;
+    float tDeltaY = 1.0f / std::fabs(dy);
+    float tMaxX = 0.5f * tDeltaX, tMaxY = 0.5f * tDeltaY;
+
+    int cx = p.x, cy = p.y, lastX = p.x, lastY = p.y;
+    bool blocked = false;
+    for (;;) {
+        if (tMaxX < tMaxY) {
+            if (tMaxX > 1.0f) break;
+            cx += stepX;
+            tMaxX += tDeltaX;
+        } else {
+            if (tMaxY > 1.0f) break;
+            cy += stepY;
+            tMaxY += tDeltaY;
+        }
+        if (!isValidAndEmpty(cx, cy)) {
+            blocked = true;
+            break;
+        }
+        lastX = cx;
+        lastY = cy;
+    }
+
+    // |vx| stays below vy, so the first step is the free cell straight down
+    // and the particle always gets somewhere
+    moveParticle(p, lastX, lastY);
+    if (blocked) {
+        // landed: the impact eats the velocity
+        p.vx = 0.0f;
+        p.vy = 0.0f;
+    }
+    return true;
+}
+
+// Try to slide the particle left or right, one cell diagonally in dy
+// (-1 = down for powders and liquids, +1 = up for gases)
+bool World::trySlide(Particle& p, int dy) {
+    // Randomly choose which direction to try first
+    bool tryLeftFirst = slideDir(gen) == 0;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int slideX = p.x + (tryLeftFirst ? -1 : 1);
+
+        // Check if we can pass the side cell and then move diagonally; a
+        // particle sliding off a slope keeps some sideways speed
+        if (entryAt(slideX, p.y, p.material, dy) != Entry::Blocked && tryEnter(p, slideX, p.y + dy, dy)) {
+            p.vx = (tryLeftFirst ? -1.0f : 1.0f) * SLIDE_SPEED;
+            return true;
+        }
+
+        // Try the other direction
+        tryLeftFirst = !tryLeftFirst;
+    }
+
+    return false; // Couldn't slide either direction
+}
+
+// Free cells of row y + dy (the level below, or above for gases) under the
+// free run of row y next to x in direction dir, as one occupancy word
+// (right: bit 0 is x + 1; left: bit 63 is x - 1). run gets the run's
+// length, up to 64: trailing zeros of the row to the right, leading zeros
+// to the left.
+uint64_t World::gapsBeside(int x, int y, int dy, int dir, int& run) const {
+    int start = dir > 0 ? x + 1 : x - 64;
+    uint64_t row = occupancyWindow(y, start);
+    run = dir > 0 ? countTrailingZeros(row) : countLeadingZeros(row);
+    if (run == 0 || y + dy < 0 || y + dy >= gridHeight)
+        return 0;
+    uint64_t runMask = dir > 0 ? (~0ull >> (64 - run)) : (~0ull << (64 - run));
+    return ~occupancyWindow(y + dy, start) & runMask;
+}
+
+// Spread sideways towards a lower level (higher for gases) within sight,
+// by up to dispersion cells in one move: it stops over the nearest gap in
+// the next row so it drops in next tick, otherwise it goes as far as it
+// may. Random direction when there are gaps both ways. With none either
+// way the surface is level as far as the particle can see, so it rests
+// instead of wandering along it; a cell vacated nearby wakes it again.
+bool World::tryDisperse(Particle& p, int dy, int dispersion) {
+    int leftRun, rightRun;
+    uint64_t left = gapsBeside(p.x, p.y, dy, -1, leftRun);
+    uint64_t right = gapsBeside(p.x, p.y, dy, 1, rightRun);
+    if (!left && !right)
+        return false;
+
+    int dir = !left ? 1 : !right ? -1 : slideDir(gen) == 0 ? -1 : 1;
+    int nearest = dir > 0 ? countTrailingZeros(right) : countLeadingZeros(left);
+    int distance = std::min(1 + nearest, dispersion);
+    moveParticle(p, p.x + dir * distance, p.y);
+    return true;
+}
+
+void World::setCell(int x, int y, uint8_t material) {
+    size_t chunk = chunkIndex(x, y);
+    OwnedChunk& owned = changeChunk(chunk);
+    uint8_t& cell = owned.planes[cellOffset(x, y)];
+    bool wasSource = MATERIALS[cell].heat > 0, isSource = MATERIALS[material].heat > 0;
+    if (wasSource != isSource)
+        heatSources[chunk] += isSource ? 1u : ~0u;
+    cell = material;
+    lodDirty[chunk] = 1;
+    uint64_t& word = owned.occupancy[y & (CHUNK_SIZE - 1)];
+    uint64_t bit = 1ull << (x & (CHUNK_SIZE - 1));
+    word = material != MAT_EMPTY ? (word | bit) : (word & ~bit);
+}
+
+// Every change of a cell's flags goes through here
+void World::setSettled(int x, int y, bool settled) {
+    size_t chunk = chunkIndex(x, y);
+    uint8_t& flags = changeChunk(chunk).planes[CHUNK_CELLS + cellOffset(x, y)];
+    flags = settled ? (flags | CELL_SETTLED) : (flags & ~CELL_SETTLED);
+    meshDirty[chunk] = 1;
+}
+
+void World::moveParticle(Particle& p, int x, int y) {
+    int oldX = p.x, oldY = p.y;
+    setCell(oldX, oldY, MAT_EMPTY);
+    p.x = x;
+    p.y = y;
+    setCell(x, y, p.material);
+    swapLifetime(oldX, oldY, x, y);
+    wakeAround(oldX, oldY);
+}
+
+// Swap p with the resting cell at (x, y). The displaced material takes p's
+// old cell and becomes a particle so it can flow away or rise. Uses the
+// reserved particle capacity, so nothing allocates.
+void World::displace(Particle& p, int x, int y) {
+    uint8_t other = cellAt(x, y);
+    setSettled(x, y, false);
+
+    int oldX = p.x, oldY = p.y;
+    setCell(x, y, p.material);
+    setCell(oldX, oldY, other);
+    swapLifetime(oldX, oldY, x, y);
+    p.x = x;
+    p.y = y;
+    if (particles.size() < MAX_PARTICLES) {
+        particles.emplace_back(oldX, oldY, other, 0);
+    } else {
+        // no room: leave it resting, it gets woken like any other settled cell
+        setSettled(oldX, oldY, true);
+    }
+}
+
+// Particle came to rest: hand it over to its chunk's static mesh. The caller
+// removes it from the particle list.
+//
+// A heavier cell resting on top (or a lighter one underneath) settled while
+// this one was moving and couldn't be displaced; now that it can, wake it.
+void World::settle(const Particle& p) {
+    setSettled(p.x, p.y, true);
+
+    uint8_t density = MATERIALS[p.material].density;
+    if (p.y + 1 < gridHeight && MATERIALS[cellAt(p.x, p.y + 1)].density > density)
+        wakeCell(p.x, p.y + 1);
+    if (p.y > 0) {
+        uint8_t below = cellAt(p.x, p.y - 1);
+        if (below != MAT_EMPTY && MATERIALS[below].density < density)
+            wakeCell(p.x, p.y - 1);
+    }
+}
+
+// Put a resting cell back into the particle list; solids stay put. Under
+// an engine without particles every cell rests in the grid.
+void World::wakeCell(int x, int y) {
+    if (!engineUsesParticles)
+        return;
+    const uint8_t* planes = chunkData(chunkIndex(x, y));
+    size_t offset = cellOffset(x, y);
+    uint8_t material = planes[offset];
+    if (!(planes[CHUNK_CELLS + offset] & CELL_SETTLED) || MATERIALS[material].behavior == Behavior::Solid)
+        return;
+    // capacity is reserved up front, so this never invalidates the
+    // caller's reference into the list
+    if (particles.size() >= MAX_PARTICLES)
+        return;
+    setSettled(x, y, false);
+    // shade 0 keeps the per-cell hash colour it had while settled
+    particles.emplace_back(x, y, material, 0);
+}
+
+// (x, y) was just vacated. Settled neighbours that could now move into it
+// (powders and liquids from above, gases from below) go back to the
+// particle list. Along the row, what can now get somewhere through (x, y)
+// is the nearest cell on either side, adjacent or a liquid / gas further
+// along that looks past (x, y) for a way down (up for gases) the way
+// tryDisperse does; it wakes only if it finds one, so a hole moving about
+// a level surface row doesn't keep waking the cells it passes.
+void World::wakeAround(int x, int y) {
+    static const int offsets[6][2] = { {0, 1}, {-1, 1}, {1, 1}, {0, -1}, {-1, -1}, {1, -1} };
+    for (const auto& o : offsets) {
+        int nx = x + o[0], ny = y + o[1];
+        if (nx >= 0 && nx < gridWidth && ny >= 0 && ny < gridHeight)
+            wakeCell(nx, ny);
+    }
+
+    for (int dir = -1; dir <= 1; dir += 2) {
+        uint64_t row = dir > 0 ? occupancyWindow(y, x + 1) : occupancyWindow(y, x - 64);
+        int run = dir > 0 ? countTrailingZeros(row) : countLeadingZeros(row);
+        int nx = x + dir * (run + 1);
+        if (run == 64 || nx < 0 || nx >= gridWidth)
+            continue;
+        const MaterialInfo& side = MATERIALS[cellAt(nx, y)];
+        if (run > 0 && side.dispersion == 0)
+            continue;
+        int dy = side.behavior == Behavior::Gas ? 1 : -1, ignored;
+        if (isValidAndEmpty(x, y + dy) || gapsBeside(x, y, dy, dir, ignored) || gapsBeside(x, y, dy, -dir, ignored))
+            wakeCell(nx, y);
+    }
+}
+
+// ------------------- Lifetimes -------------------
+// Give a freshly placed cell of material its lifetime (random within the
+// material's range so a blob doesn't vanish all at once)
+void World::startLifetime(int x, int y, uint8_t material) {
+    const MaterialInfo& info = MATERIALS[material];
+    uint8_t& life = changeChunk(chunkIndex(x, y)).planes[2 * CHUNK_CELLS + cellOffset(x, y)];
+    bool wasAging = life != 0;
+    life = info.lifeMax ? (uint8_t)std::uniform_int_distribution<int>(info.lifeMin, info.lifeMax)(gen) : 0;
+    agingCells[chunkIndex(x, y)] += (uint32_t)(life != 0) - (uint32_t)wasAging;
+}
+
+// Lifetimes travel with their cells
+void World::swapLifetime(int ax, int ay, int bx, int by) {
+    size_t chunkA = chunkIndex(ax, ay), chunkB = chunkIndex(bx, by);
+    uint8_t& a = changeChunk(chunkA).planes[2 * CHUNK_CELLS + cellOffset(ax, ay)];
+    uint8_t& b = changeChunk(chunkB).planes[2 * CHUNK_CELLS + cellOffset(bx, by)];
+    if (a == b)
+        return;
+    if (chunkA != chunkB) {
+        uint32_t delta = (uint32_t)(b != 0) - (uint32_t)(a != 0);
+        agingCells[chunkA] += delta;
+        agingCells[chunkB] -= delta;
+    }
+    std::swap(a, b);
+}
+
+// Count down every running lifetime in a row. Branch-free over plain bytes
+// so the compiler turns it into SIMD compares and subtracts; returns whether
+// any cell ran out.
+static bool ageRow(uint8_t* life, int count) {
+    uint8_t expired = 0;
+    for (int i = 0; i < count; i++) {
+        uint8_t v = life[i];
+        expired |= (uint8_t)(v == 1);
+        life[i] = (uint8_t)(v - (v != 0));
+    }
+    return expired != 0;
+}
+
+// Once per tick, before particles move. Chunks without ageing cells cost
+// one compare; rows without an expiry cost the vector sweep only.
+void World::ageCells() {
+    int cx = chunksX();
+    for (size_t c = 0; c < agingCells.size(); c++) {
+        if (agingCells[c] == 0)
+            continue;
+        // Owned from here on, so the planes stay put while cells expire
+        // and react
+        uint8_t* planes = changeChunk(c).planes;
+        const uint8_t* life = planes + 2 * CHUNK_CELLS;
+        int x0 = (int)(c % cx) * CHUNK_SIZE, y0 = (int)(c / cx) * CHUNK_SIZE;
+        int w = std::min(CHUNK_SIZE, gridWidth - x0), h = std::min(CHUNK_SIZE, gridHeight - y0);
+        for (int j = 0; j < h; j++) {
+            size_t rowStart = (size_t)j * CHUNK_SIZE;
+            if (!ageRow(planes + 2 * CHUNK_CELLS + rowStart, w))
+                continue;
+            for (int x = 0; x < w; x++)
+                if (life[rowStart + x] == 0 && MATERIALS[planes[rowStart + x]].lifeMax != 0)
+                    expireCell(x0 + x, y0 + j);
+        }
+
+        // Burning cells are active too, but there are many of them and they
+        // don't move, so they look for something to react with (fire
+        // spreading into wood) only every few ticks, staggered per chunk
+        if ((c + tickCount) % REACTION_SCAN_INTERVAL != 0)
+            continue;
+        for (int j = 0; j < h; j++) {
+            size_t rowStart = (size_t)j * CHUNK_SIZE;
+            for (int x = 0; x < w; x++)
+                if (life[rowStart + x] != 0 && reactionTable.reactive(planes[rowStart + x]))
+                    react(x0 + x, y0 + j);
+        }
+    }
+}
+
+// The cell at (x, y) ran out of time: it turns into its decay material, or
+// vanishes. Works on the grid alone; a moving cell's particle picks up the
+// new material when it updates, or is dropped in step() if it vanished.
+void World::expireCell(int x, int y) {
+    uint8_t next = MATERIALS[cellAt(x, y)].decaysTo;
+    bool settled = (flagsAt(x, y) & CELL_SETTLED) != 0;
+    agingCells[chunkIndex(x, y)]--;
+    if (next != MAT_EMPTY) {
+        transformCell(x, y, next);
+        return;
+    }
+
+    setCell(x, y, MAT_EMPTY);
+    if (settled)
+        setSettled(x, y, false);
+    staleParticles |= !settled;
+    wakeAround(x, y);
+}
+
+// Turn the (non-empty) cell at (x, y) into material in place
+void World::transformCell(int x, int y, uint8_t material) {
+    setCell(x, y, material);
+    startLifetime(x, y, material);
+    if (flagsAt(x, y) & CELL_SETTLED) {
+        meshDirty[chunkIndex(x, y)] = 1;
+        // e.g. burnt-out fire: the smoke it leaves has to start rising
+        wakeCell(x, y);
+    }
+}
+
+// Active cell at (x, y) against its four neighbours, one table read each;
+// the first reaction that fires ends the check
+void World::react(int x, int y) {
+    static const int offsets[4][2] = { {0, -1}, {-1, 0}, {1, 0}, {0, 1} };
+    uint8_t self = cellAt(x, y);
+    for (const auto& o : offsets) {
+        int nx = x + o[0], ny = y + o[1];
+        if (nx < 0 || nx >= gridWidth || ny < 0 || ny >= gridHeight)
+            continue;
+        uint8_t other = cellAt(nx, ny);
+        const Reaction& r = reactionTable.lookup(self, other);
+        if (r.chance == 0 || reactionRoll(gen) >= r.chance)
+            continue;
+        if (r.toOther != other)
+            transformCell(nx, ny, r.toOther);
+        if (r.toSelf != self)
+            transformCell(x, y, r.toSelf);
+        return;
+    }
+}
+
+// ------------------- Heat -------------------
+// Feed the field from chunks holding heat sources, let materials react to
+// it, then diffuse. Hot chunks are checked for melting, boiling and
+// ignition every HEAT_SCAN_INTERVAL ticks, staggered so they don't all land
+// on the same tick; a hot enough cell then changes with a 1 in 4 chance,
+// so a pool boils off over a while instead of all at once.
+void World::updateHeat() {
+    int cx = chunksX();
+    for (size_t c = 0; c < heatSources.size(); c++) {
+        bool feed = heatSources[c] != 0;
+        bool scan = heat.regionHot(c) && (c + tickCount) % HEAT_SCAN_INTERVAL == 0;
+        if (!feed && !scan)
+            continue;
+        int x0 = (int)(c % cx) * CHUNK_SIZE, y0 = (int)(c / cx) * CHUNK_SIZE;
+        int x1 = std::min(x0 + CHUNK_SIZE, gridWidth), y1 = std::min(y0 + CHUNK_SIZE, gridHeight);
+
+        if (feed) {
+            touchChunk(c, CAPTURE_HEAT);
+            const uint8_t* planes = chunkData(c);
+            for (int y = y0; y < y1; y++) {
+                const uint8_t* row = planes + (size_t)(y - y0) * CHUNK_SIZE;
+                for (int x = x0; x < x1; x++)
+                    if (MATERIALS[row[x - x0]].heat > 0)
+                        heat.raise(x / HEAT_SCALE, y / HEAT_SCALE, MATERIALS[row[x - x0]].heat);
+            }
+        }
+        if (scan) {
+            // The chunk's cells against its own heat region
+            const int hs = CHUNK_SIZE / HEAT_SCALE;
+            const uint8_t* planes = chunkData(c);
+            const float* temperature = heat.region(c);
+            for (int j = 0; j < y1 - y0; j++) {
+                for (int i = 0; i < x1 - x0; i++) {
+                    const MaterialInfo& info = MATERIALS[planes[j * CHUNK_SIZE + i]];
+                    if (info.changesAbove > 0 && temperature[j / HEAT_SCALE * hs + i / HEAT_SCALE] > info.changesAbove &&
+                        changeChance(gen) == 0) {
+                        transformCell(x0 + i, y0 + j, info.changesTo);
+                        planes = chunkData(c);     // owned from the first change
+                    }
+                }
+            }
+        }
+    }
+    // Stepping rewrites the awake regions
+    for (size_t r = 0; r < heat.regionCount(); r++)
+        if (heat.regionAwake(r))
+            touchChunk(r, CAPTURE_HEAT);
+    heat.step();
+}
+
+void World::setEngine(std::unique_ptr<SimulationEngine> engine) {
+    if (!engine)
+        return;
+    bool usesParticles = (engine->capabilities() & ENGINE_PARTICLES) != 0;
+    activeEngine = std::move(engine);
+    if (usesParticles == engineUsesParticles)
+        return;
+    engineUsesParticles = usesParticles;
+    if (!usesParticles) {
+        // Everything in flight comes to rest where it is; the engine moves
+        // it on from the grid
+        for (const auto& p : particles)
+            setSettled(p.x, p.y, true);
+        particles.clear();
+    } else {
+        // Wake whatever might move; what can't settles again on its first
+        // update. Chunks that were never filled have nothing to wake.
+        for (size_t c = 0; c < chunkPlanes.size(); c++) {
+            if (chunkPlanes[c] == blankPlanes)
+                continue;
+            int x0 = (int)(c % chunkColumns) * CHUNK_SIZE, y0 = (int)(c / chunkColumns) * CHUNK_SIZE;
+            for (int y = y0; y < std::min(y0 + CHUNK_SIZE, gridHeight); y++)
+                for (int x = x0; x < std::min(x0 + CHUNK_SIZE, gridWidth); x++)
+                    if (cellAt(x, y) != MAT_EMPTY)
+                        wakeCell(x, y);
+        }
+    }
+}
+
+// Lifetimes first: the engine then sees cells that burnt out as gone
+void World::step() {
+    ageCells();
+    updateHeat();
+    activeEngine->step(*this, tickCount);
+    tickCount++;
+    evictSleepingChunks();
+}
+
+// Rearrange the 2x2 block with bottom-left cell (x, y) by a Margolus
+// permutation (margolus.h); material, flags and lifetime move together.
+// Half a block may hang over the left or right edge of the world as long as
+// the permutation leaves that half in place.
+void World::moveBlock(int x, int y, uint8_t permutation) {
+    const int px[4] = { x, x + 1, x, x + 1 };
+    const int py[4] = { y + 1, y + 1, y, y };
+    uint8_t material[4] = {}, flags[4] = {}, life[4] = {};
+    for (int i = 0; i < 4; i++) {
+        if (px[i] < 0 || px[i] >= gridWidth)
+            continue;
+        const uint8_t* planes = chunkData(chunkIndex(px[i], py[i]));
+        size_t offset = cellOffset(px[i], py[i]);
+        material[i] = planes[offset];
+        flags[i] = planes[CHUNK_CELLS + offset];
+        life[i] = planes[2 * CHUNK_CELLS + offset];
+    }
+    for (int i = 0; i < 4; i++) {
+        int from = margolusSource(permutation, i);
+        if (from == i)
+            continue;
+        size_t chunk = chunkIndex(px[i], py[i]);
+        setCell(px[i], py[i], material[from]);
+        uint8_t* planes = ownedChunks[chunk]->planes;
+        size_t offset = cellOffset(px[i], py[i]);
+        planes[CHUNK_CELLS + offset] = flags[from];
+        planes[2 * CHUNK_CELLS + offset] = life[from];
+        agingCells[chunk] += (uint32_t)(life[from] != 0) - (uint32_t)(life[i] != 0);
+        meshDirty[chunk] = 1;
+    }
+}
+
+void World::buildSnapshot(RenderSnapshot& snapshot, bool withLod) {
+    snapshot.tick = tickCount;
+    snapshot.gridWidth = gridWidth;
+    snapshot.gridHeight = gridHeight;
+    snapshot.chunkSize = CHUNK_SIZE;
+    snapshot.chunksX = chunksX();
+    snapshot.chunksY = chunksY();
+    size_t chunkCount = (size_t)snapshot.chunksX * snapshot.chunksY;
+
+    // ------------------- Static Layer: Greedy Meshes -------------------
+    // A dirty chunk gets a fresh mesh object; older snapshots may still hold
+    // the previous one. Snapshot buffers are reused, so only pointers that
+    // changed are reassigned.
+    snapshot.staticChunks.resize(chunkCount);
+    for (size_t c = 0; c < chunkCount; c++) {
+        if (meshDirty[c]) {
+            int x0 = (int)(c % snapshot.chunksX) * CHUNK_SIZE;
+            int y0 = (int)(c / snapshot.chunksX) * CHUNK_SIZE;
+            auto mesh = std::make_shared<ChunkMesh>();
+            mesh->version = nextMeshVersion.fetch_add(1, std::memory_order_relaxed);
+            const uint8_t* planes = chunkData(c);
+            greedyMeshRegion(planes, planes + CHUNK_CELLS, CELL_SETTLED, CHUNK_SIZE, x0, y0,
+                             std::min(CHUNK_SIZE, gridWidth - x0), std::min(CHUNK_SIZE, gridHeight - y0),
+                             mesh->quads);
+            chunkMeshes[c] = std::move(mesh);
+            meshDirty[c] = 0;
+        }
+        if (snapshot.staticChunks[c] != chunkMeshes[c])
+            snapshot.staticChunks[c] = chunkMeshes[c];
+    }
+
+    // ------------------- LOD Pyramid -------------------
+    // Dirty flags keep accumulating while nobody asks, so switching LOD on
+    // only rebuilds what changed since it was last used
+    snapshot.lodLevels = LOD_LEVELS;
+    if (!withLod) {
+        snapshot.lodChunks.clear();
+    } else {
+        snapshot.lodChunks.resize(chunkCount);
+        for (size_t c = 0; c < chunkCount; c++) {
+            if (lodDirty[c]) {
+                int x0 = (int)(c % snapshot.chunksX) * CHUNK_SIZE;
+                int y0 = (int)(c / snapshot.chunksX) * CHUNK_SIZE;
+                auto tile = std::make_shared<ChunkLod>();
+                tile->version = nextMeshVersion.fetch_add(1, std::memory_order_relaxed);
+                buildChunkLod(chunkData(c), CHUNK_SIZE,
+                              std::min(CHUNK_SIZE, gridWidth - x0), std::min(CHUNK_SIZE, gridHeight - y0),
+                              CHUNK_SIZE, LOD_LEVELS, tile->texels);
+                lodTiles[c] = std::move(tile);
+                lodDirty[c] = 0;
+            }
+            if (snapshot.lodChunks[c] != lodTiles[c])
+                snapshot.lodChunks[c] = lodTiles[c];
+        }
+    }
+
+    // ------------------- Dynamic Layer: Moving Particles -------------------
+    // Counting sort by chunk: one pass to count, one to place
+    chunkCounts.assign(chunkCount, 0);
+    for (const auto& p : particles)
+        chunkCounts[chunkIndex(p.x, p.y)]++;
+
+    snapshot.chunkOffsets.resize(chunkCount + 1);
+    uint32_t offset = 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+        snapshot.chunkOffsets[i] = offset;
+        offset += chunkCounts[i];
+        chunkCounts[i] = snapshot.chunkOffsets[i];   // reuse as write cursor
+    }
+    snapshot.chunkOffsets[chunkCount] = offset;
+
+    snapshot.instances.resize(particles.size());
+    for (const auto& p : particles) {
+        uint32_t& cursor = chunkCounts[chunkIndex(p.x, p.y)];
+        snapshot.instances[cursor++] = InstanceData(p.x, p.y, p.material, p.shade);
+    }
+}
+
+// ====================== Simulation Thread ======================
+SimulationThread::SimulationThread(World& w)
+    : world(w), running(false), speed(SimSpeed::RealTime) {}
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::start() {
+    if (running.exchange(true)) return;
+    worker = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+    running = false;
+    if (worker.joinable())
+        worker.join();
+}
+
+void SimulationThread::runTick() {
+    // Between ticks the world is consistent; the renderer keeps drawing the
+    // last snapshot while the file is written
+    if (input.save.exchange(false, std::memory_order_relaxed)) {
+        auto start = std::chrono::steady_clock::now();
+        if (world.save(savePath)) {
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Saved " << savePath << " at tick " << world.tick() << " (" << ms << " ms)\n";
+        }
+    }
+    TickInput tickInput;
+    if (replay) {
+        tickInput = replay->inputAt(world.tick());
+    } else {
+        tickInput.spawning = input.spawning.load(std::memory_order_relaxed);
+        tickInput.gridX = input.gridX.load(std::memory_order_relaxed);
+        tickInput.gridY = input.gridY.load(std::memory_order_relaxed);
+        tickInput.material = input.material.load(std::memory_order_relaxed);
+    }
+    if (recorder)
+        recorder->record(world.tick(), tickInput);
+    world.applyInput(tickInput.spawning, tickInput.gridX, tickInput.gridY, tickInput.material);
+    world.step();
+    if (checkpointer)
+        checkpointer->afterTick(world);
+    stats.ticks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SimulationThread::publishSnapshot() {
+    world.buildSnapshot(snapshots.writeBuffer(), input.lod.load(std::memory_order_relaxed));
+    if (snapshots.publish())
+        stats.dropped.fetch_add(1, std::memory_order_relaxed);
+    stats.published.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SimulationThread::run() {
+    using clock = std::chrono::steady_clock;
+    const auto tickDuration = std::chrono::nanoseconds(1000000000 / TICK_RATE);
+    const int maxCatchUpTicks = 5;
+    auto nextTick = clock::now();
+
+    while (running.load(std::memory_order_relaxed)) {
+        if (speed.load(std::memory_order_relaxed) == SimSpeed::Uncapped) {
+            // Spend everything on ticks; a snapshot is only worth building
+            // once the renderer has picked up the previous one.
+            runTick();
+            if (!snapshots.pending())
+                publishSnapshot();
+            nextTick = clock::now();
+            continue;
+        }
+
+        // Run the ticks that are due; if we fall far behind, drop the backlog
+        // instead of spiralling.
+        int ticksRun = 0;
+        while (clock::now() >= nextTick && ticksRun < maxCatchUpTicks) {
+            runTick();
+            nextTick += tickDuration;
+            ticksRun++;
+        }
+        if (ticksRun == maxCatchUpTicks)
+            nextTick = clock::now();
+
+        if (ticksRun > 0)
+            publishSnapshot();
+
+        std::this_thread::sleep_until(nextTick);
+    }
+}
@@ -0,0 +1,442 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "engine.h"
+#include "heat.h"
+#include "materials.h"
+#include "pacing.h"
+#include "paged_world.h"
+#include "reactions.h"
+#include "snapshot.h"
+#include "triple_buffer.h"
+
+// ====================== Simulation Constants ======================
+const int DEFAULT_GRID_SIZE = 300;
+const int MAX_GRID_SIZE = 65535;    // cells are addressed with uint16 on the GPU
+const int CHUNK_SIZE = 64;          // cells per chunk side (culling / bookkeeping / storage granularity)
+const int CHUNK_CELLS = CHUNK_SIZE * CHUNK_SIZE;
+const int LOD_LEVELS = 7;           // LOD mips per chunk tile: 64x64 cells down to 1x1
+static_assert(CHUNK_SIZE == 1 << (LOD_LEVELS - 1), "LOD tiles must reduce a chunk to one texel");
+const unsigned int MAX_PARTICLES = 100000;   // moving particles; settled cells live only in the grid
+const int TICK_RATE = 100;          // simulation ticks per second
+const float SPAWN_RATE = 100.0f;    // particles per second when holding mouse
+const float GRAVITY = 0.2f;         // cells per tick^2 for falling powders and liquids
+const float MAX_FALL_SPEED = 12.0f; // cells per tick
+const float SLIDE_SPEED = 0.5f;     // sideways velocity picked up when sliding off a slope
+const float AIR_DRAG = 0.9f;        // per-tick decay of sideways velocity while falling
+const int HEAT_SCALE = 4;           // world cells per heat field cell side
+const int HEAT_SCAN_INTERVAL = 4;   // ticks between melt / boil / ignite checks of a hot chunk
+static_assert(CHUNK_SIZE % HEAT_SCALE == 0, "heat regions must line up with chunks");
+const int REACTION_SCAN_INTERVAL = 4;   // ticks between reaction checks of a chunk's burning cells
+const int CHECKPOINT_CHUNKS_PER_TICK = 16;  // chunks a checkpoint copies per tick ahead of completing
+const int CHECKPOINT_FINAL_CHUNKS = 64;     // most chunks left to copy when a checkpoint fixes its tick
+const int CHECKPOINT_SETTLE_TICKS = TICK_RATE;  // extra ticks to wait for that before fixing it anyway
+const int PAGE_EVICT_TICKS = 10 * TICK_RATE;    // ticks without a change around a mapped chunk before it is evicted
+const int PAGE_EVICT_CHECKS = 64;           // mapped chunks looked at for eviction per tick
+
+// Per-cell flag bits
+const uint8_t CELL_SETTLED = 1 << 0;    // occupant has come to rest (static layer, not in the particle list)
+
+// Parts of a chunk a checkpoint copies, each copied on write on its own
+const uint8_t CAPTURE_CELLS = 1 << 0;   // material, flag and lifetime planes
+const uint8_t CAPTURE_HEAT = 1 << 1;    // heat region
+const uint8_t CAPTURE_ALL = CAPTURE_CELLS | CAPTURE_HEAT;
+
+// ====================== Particle Struct ======================
+// A moving particle. Once it comes to rest it is removed from the particle
+// list and only exists as a settled cell until something below it moves.
+struct Particle {
+    int x, y;
+    float vx, vy;       // cells per tick; vy > 0 is downwards
+    uint8_t material;
+    uint8_t shade;
+    uint16_t unused = 0;   // world files store particles as they are in memory
+
+    Particle() : x(0), y(0), vx(0), vy(0), material(MAT_EMPTY), shade(0) {}
+    Particle(int px, int py, uint8_t mat, uint8_t s) : x(px), y(py), vx(0), vy(0), material(mat), shade(s) {}
+};
+
+// ====================== Byte Lanes ======================
+// Eight cells at a time in a 64-bit word: one load covers eight cells'
+// bytes, and per-cell facts kept as bits (occupancy, cells that could
+// move) come out as one bit per lane.
+inline uint64_t load8(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+// The byte lanes of v that aren't zero, as each lane's top bit
+inline uint64_t nonZeroLanes(uint64_t v) {
+    const uint64_t low7 = 0x7f7f7f7f7f7f7f7full;
+    return (((v & low7) + low7) | v) & ~low7;
+}
+
+// Lane top bits packed into 8 bits, lane i to bit i
+inline uint64_t packLanes(uint64_t lanes) {
+    return ((lanes >> 7) * 0x0102040810204080ull) >> 56;
+}
+
+// Occupancy word of a chunk row: bit i set when row[i] isn't empty
+inline uint64_t rowOccupancy(const uint8_t* row) {
+    static_assert(CHUNK_SIZE == 64, "a chunk row is exactly one occupancy word");
+    uint64_t bits = 0;
+    for (int i = 0; i < CHUNK_SIZE; i += 8)
+        bits |= packLanes(nonZeroLanes(load8(row + i))) << i;
+    return bits;
+}
+
+struct FileReader;
+
+// A paged world file the world's unchanged chunks are read from in place
+struct PagedSource {
+    PagedWorldFile file;
+    uint8_t remap[256];             // saved material id -> ours
+    uint32_t materialCount;
+    bool identity;                  // saved ids are ours: chunks are used straight from the mapping
+};
+
+// ====================== Checkpoint Capture ======================
+// One checkpoint's worth of world state, in the paged world file layout,
+// as of the tick the checkpoint completes (see World::beginCheckpoint).
+// Reused from one checkpoint to the next so a steady run doesn't allocate.
+struct CheckpointCapture {
+    int width = 0, height = 0;
+    bool everything = false;             // every chunk captured, not just changed ones
+    PagedWorldHeader header;             // world fields only
+    std::vector<PagedChunkEntry> chunkInfo;  // per chunk: heat flags and counts (offsets unused)
+    std::vector<uint8_t> extra;          // random state and particles
+    std::vector<uint32_t> chunks;        // captured chunk indices
+    std::vector<uint8_t> blank;          // per captured chunk: nothing stored, no data
+    std::vector<uint32_t> slots;         // per captured chunk: its buffer in data, unless blank
+    std::vector<std::vector<uint8_t>> data;
+    size_t dataUsed = 0;
+    size_t frozenChunks = 0;             // chunks still to copy when its tick was fixed
+    size_t copiedOnWrite = 0;            // copies of their parts made right before those changed
+};
+
+// ====================== World ======================
+// Grid + particle state. Only ever touched by the thread that steps it.
+class World
+{
+public:
+    World(int width, int height);
+    World(int width, int height, uint32_t seed);
+
+    int width() const { return gridWidth; }
+    int height() const { return gridHeight; }
+    int chunksX() const { return chunkColumns; }
+    int chunksY() const { return (gridHeight + CHUNK_SIZE - 1) / CHUNK_SIZE; }
+
+    // Spawn one cell of material in the first free cell near (gridX, gridY).
+    // Solids are placed directly as settled cells, everything else as a particle.
+    bool spawnNear(int gridX, int gridY, uint8_t material);
+
+    // Per-tick input: while spawning, emits SPAWN_RATE cells per simulated second
+    void applyInput(bool spawning, int gridX, int gridY, uint8_t material);
+
+    // Plug in the engine that moves cells (see engine.h). Starts with the
+    // auto-selected one; cells in flight are handed over as they are.
+    void setEngine(std::unique_ptr<SimulationEngine> engine);
+    const SimulationEngine& engine() const { return *activeEngine; }
+
+    // Advance the simulation by one tick
+    void step();
+
+    // Copy the drawable state into a snapshot: moving particles as instances
+    // grouped by chunk, settled cells as shared per-chunk greedy meshes
+    // (rebuilt only for chunks that changed since the last snapshot), and
+    // with withLod the per-chunk LOD pyramid (likewise incremental)
+    void buildSnapshot(RenderSnapshot& snapshot, bool withLod = false);
+
+    // Material of the cell at (x, y), which must be inside the grid
+    uint8_t cellAt(int x, int y) const { return chunkData(chunkIndex(x, y))[cellOffset(x, y)]; }
+    uint64_t tick() const { return tickCount; }
+    size_t movingCount() const { return particles.size(); }
+
+    // Incremental checkpoints (checkpoint.h). beginCheckpoint only marks
+    // the chunks changed since the last checkpoint (or all of them, with
+    // everything). continueCheckpoint, called between ticks, copies a few of
+    // them per tick and marks any that change again after their copy. Once
+    // at most CHECKPOINT_FINAL_CHUNKS are left (or the settle ticks have run
+    // out) it fixes the capture at that tick boundary with the header,
+    // particles and random state, and keeps copying the rest a few per
+    // tick; step() copies any of them it is about to change first. The
+    // capture comes back once all are in. takeCheckpointCopyNs returns and
+    // clears the time step() has spent on those copies.
+    void beginCheckpoint(std::unique_ptr<CheckpointCapture> capture, bool everything);
+    std::unique_ptr<CheckpointCapture> continueCheckpoint(int chunkBudget);
+    bool capturingCheckpoint() const { return checkpoint != nullptr; }
+    uint64_t takeCheckpointCopyNs();
+    // Whether a chunk copy (paged file layout) holds nothing a fresh world doesn't
+    static bool blankChunk(const uint8_t* data);
+
+    // Write the complete state to a world file: run-length encoded (format
+    // in world_io.cpp), or chunk-paged for mapping (paged_world.h) when the
+    // path ends in .sandpage. load reads either, replacing this world, size
+    // included, but keeps the active engine; on failure the world is left
+    // unchanged. A paged file stays mapped and the world reads its chunks
+    // from it until they change (see Chunk Storage below).
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+    // Replace the contents with width x height cells of materials (ids below
+    // MAT_COUNT, row-major, bottom row first), size included like load:
+    // everything rests in the grid except the cells that could move, which
+    // start as particles (terrain.h). Tick, random state and engine carry on.
+    void importCells(int width, int height, const uint8_t* materials);
+
+private:
+    // Engines drive the movement primitives below
+    friend class ParticleEngine;
+    friend class MargolusEngine;
+
+    // Per-material update rules, specialized at compile time on the material
+    // (behaviour and constants folded in) and reached through one indexed
+    // call in step(). Return false once the particle has come to rest.
+    using UpdateFn = bool (*)(World&, Particle&);
+    template <Material M> static bool updateParticle(World& world, Particle& p);
+    template <size_t... I> static constexpr std::array<UpdateFn, sizeof...(I)> makeUpdateTable(std::index_sequence<I...>);
+    static const std::array<UpdateFn, MAT_COUNT> updateTable;
+    static const ReactionTable reactionTable;
+
+    enum class Entry : uint8_t { Blocked, Free, Displace };
+
+    // Chunk storage (below)
+    struct OwnedChunk {
+        uint8_t planes[3 * CHUNK_CELLS];    // material, flags, lifetime; rows CHUNK_SIZE apart
+        uint64_t occupancy[CHUNK_SIZE];     // per row, set past the world's right edge
+    };
+    static size_t cellOffset(int x, int y) { return (size_t)(y & (CHUNK_SIZE - 1)) * CHUNK_SIZE + (x & (CHUNK_SIZE - 1)); }
+    const uint8_t* chunkData(size_t chunk) const {
+        const uint8_t* planes = chunkPlanes[chunk];
+        return planes ? planes : pageIn(chunk);
+    }
+    uint8_t flagsAt(int x, int y) const { return chunkData(chunkIndex(x, y))[CHUNK_CELLS + cellOffset(x, y)]; }
+    uint8_t lifetimeAt(int x, int y) const { return chunkData(chunkIndex(x, y))[2 * CHUNK_CELLS + cellOffset(x, y)]; }
+    // The chunk's own copy, made on its first change; calls touchChunk
+    OwnedChunk& changeChunk(size_t chunk) {
+        touchChunk(chunk, CAPTURE_CELLS);
+        OwnedChunk* owned = ownedChunks[chunk].get();
+        return owned ? *owned : ownChunk(chunk);
+    }
+    OwnedChunk& ownChunk(size_t chunk);
+    const uint8_t* pageIn(size_t chunk) const;
+    // Occupancy of chunk column cx (-1 and chunksX() are the walls past the
+    // edges) in row y
+    uint64_t occupancyWord(int cx, int y) const {
+        if ((unsigned)cx >= (unsigned)chunkColumns)
+            return ~0ull;
+        size_t chunk = (size_t)(y / CHUNK_SIZE) * chunkColumns + cx;
+        const OwnedChunk* owned = ownedChunks[chunk].get();
+        return owned ? owned->occupancy[y & (CHUNK_SIZE - 1)] : sharedOccupancy(chunk, y);
+    }
+    uint64_t sharedOccupancy(size_t chunk, int y) const;
+    void copyRow(int y, int x, int count, uint8_t* out, int plane = 0) const;
+    const uint8_t* rowSpan(int y, int x, int count, uint8_t* scratch) const;
+    void evictSleepingChunks();
+
+    bool isValidAndEmpty(int x, int y) const;
+    Entry entryAt(int x, int y, uint8_t material, int dy) const;
+    bool tryEnter(Particle& p, int x, int y, int dy);
+    bool trySlide(Particle& p, int dy);
+    bool fall(Particle& p);
+    bool tryDisperse(Particle& p, int dy, int dispersion);
+    uint64_t gapsBeside(int x, int y, int dy, int dir, int& run) const;
+    // Occupancy of cells [start, start + 64) of row y, bit i = cell start + i.
+    // start may be as low as -64; cells past the edges read as occupied.
+    uint64_t occupancyWindow(int y, int start) const {
+        int bit = start + 64;           // chunk column -1 is the left wall
+        int cx = (bit >> 6) - 1, offset = bit & 63;
+        uint64_t low = occupancyWord(cx, y);
+        if (offset == 0)
+            return low;
+        return (low >> offset) | (occupancyWord(cx + 1, y) << (64 - offset));
+    }
+    void moveParticle(Particle& p, int x, int y);
+    void displace(Particle& p, int x, int y);
+    void settle(const Particle& p);
+    void wakeCell(int x, int y);
+    void wakeAround(int x, int y);
+    void setCell(int x, int y, uint8_t material);
+    void startLifetime(int x, int y, uint8_t material);
+    void swapLifetime(int ax, int ay, int bx, int by);
+    void ageCells();
+    void expireCell(int x, int y);
+    void transformCell(int x, int y, uint8_t material);
+    void react(int x, int y);
+    void moveBlock(int x, int y, uint8_t permutation);
+    void updateHeat();
+    bool readCells(FileReader& in, const uint8_t* remap, uint32_t materialCount);
+    bool copyChunk(size_t chunk, uint8_t* out) const;
+    void pagedState(PagedWorldHeader& header, std::vector<PagedChunkEntry>& chunkInfo, std::vector<uint8_t>& extra) const;
+    bool savePaged(const std::string& path) const;
+    bool loadPaged(const std::string& path);
+    void setSettled(int x, int y, bool settled);
+    void captureChunk(size_t chunk, uint8_t parts);
+    void copyBeforeChange(size_t chunk, uint8_t parts);
+
+    // Called before parts (CAPTURE_CELLS, CAPTURE_HEAT) of chunk change:
+    // remember it for the next checkpoint, and for the one being captured
+    // either copy it again later or, once that one's tick is fixed, copy
+    // those parts now if still needed
+    void touchChunk(size_t chunk, uint8_t parts) {
+        if (checkpoint) {
+            if (!checkpointFrozen && !capturePending[chunk]) {
+                capturePending[chunk] = CAPTURE_ALL;
+                pendingChunks.push_back((uint32_t)chunk);
+            } else if (checkpointFrozen && (capturePending[chunk] & parts)) {
+                copyBeforeChange(chunk, capturePending[chunk] & parts);
+            }
+        }
+        checkpointDirty[chunk] = 1;
+        chunkChangedAt[chunk] = tickCount;
+    }
+    size_t chunkIndex(int x, int y) const { return (size_t)(y / CHUNK_SIZE) * chunkColumns + x / CHUNK_SIZE; }
+
+    int gridWidth, gridHeight;
+    int chunkColumns;
+    std::unique_ptr<SimulationEngine> activeEngine;
+    bool engineUsesParticles;       // cached ENGINE_PARTICLES of the active engine
+    std::vector<Particle> particles;
+
+    // ------------------- Chunk Storage -------------------
+    // Cells are stored per chunk: material, CELL_* flags and lifetime
+    // planes of 64x64 bytes each, one block per chunk, which is also a
+    // chunk's layout in a paged world file. chunkPlanes points each chunk at
+    // its block: one shared all-empty block, the chunk in the mapped file
+    // the world was loaded from (nullptr until first read), or the chunk's
+    // OwnedChunk. A chunk gets its own copy on its first change, so memory
+    // goes to what changed, not to the world's size.
+    //
+    // The OwnedChunk also keeps one occupancy bit per cell, set when
+    // occupied, so sideways scans read 64 cells at a time; for the other
+    // chunks the bits are worked out from the cells when asked for. Past
+    // the world's edges everything reads as occupied, so the border is a
+    // wall and windows never need bounds checks.
+    //
+    // Lifetime is the ticks left per cell for materials with one (fire,
+    // smoke, steam), 0 for everything else. Kept apart from the cells so
+    // ageing is a byte-wide sweep that never touches particles; only chunks
+    // with a non-zero count of ageing cells are swept.
+    //
+    // Mapped chunks nothing has changed around for PAGE_EVICT_TICKS are
+    // evicted a few per tick: their pages go back to the OS and the next
+    // read maps them in again.
+    mutable std::vector<const uint8_t*> chunkPlanes;
+    mutable std::vector<std::unique_ptr<OwnedChunk>> ownedChunks;
+    std::unique_ptr<PagedSource> pagedSource;
+    mutable std::vector<uint32_t> mappedChunks;     // mapped chunks that may be resident
+    size_t evictCursor;
+    std::vector<uint64_t> chunkChangedAt;           // tick of each chunk's last change
+    std::vector<uint32_t> agingCells;   // per chunk
+    bool staleParticles;            // a moving cell expired, its particle must go
+
+    // Temperature at 1/HEAT_SCALE resolution, one heat region per chunk.
+    // heatSources counts the cells of heat-emitting materials per chunk so
+    // only those chunks are scanned to feed the field.
+    HeatField heat;
+    std::vector<uint32_t> heatSources;
+    uint64_t tickCount;
+    float spawnAccumulator;
+
+    // Random number generator for sliding direction
+    std::mt19937 gen;
+    std::uniform_int_distribution<> slideDir;  // 0 = left first, 1 = right first (slides and flow)
+    std::uniform_int_distribution<> shadeDist; // per-particle colour variation
+    std::uniform_int_distribution<> changeChance; // 0 = a hot enough cell melts / boils / ignites this scan
+    std::uniform_int_distribution<> reactionRoll; // a reaction fires when this is below its chance
+
+    // settled-cell meshes per chunk, rebuilt lazily when meshDirty is set
+    std::vector<std::shared_ptr<const ChunkMesh>> chunkMeshes;
+    std::vector<uint8_t> meshDirty;
+
+    // LOD tiles per chunk, rebuilt lazily when lodDirty is set (any cell change)
+    std::vector<std::shared_ptr<const ChunkLod>> lodTiles;
+    std::vector<uint8_t> lodDirty;
+
+    // snapshot scratch: instances per chunk
+    std::vector<uint32_t> chunkCounts;
+
+    // Checkpoints: chunks changed since they were last captured, and while
+    // one is being captured, the chunks it still has to (re)copy, oldest
+    // first, and which of their parts, where each chunk's copy is in it,
+    // whether its tick is fixed, and the time spent copying on write since
+    // last taken
+    std::vector<uint8_t> checkpointDirty;
+    std::vector<uint8_t> capturePending;
+    std::deque<uint32_t> pendingChunks;
+    std::vector<int32_t> captureEntry;
+    std::unique_ptr<CheckpointCapture> checkpoint;
+    uint64_t checkpointDeadline;
+    bool checkpointFrozen;
+    uint64_t checkpointCopyNs;
+};
+
+// ====================== Simulation Thread ======================
+// Input state written by the render thread and sampled once per tick.
+struct SimInput {
+    std::atomic<bool> spawning{false};
+    std::atomic<uint8_t> material{MAT_SAND};
+    std::atomic<bool> lod{false};       // renderer wants the LOD pyramid in snapshots
+    std::atomic<int> gridX{0};
+    std::atomic<int> gridY{0};
+    std::atomic<bool> save{false};      // write the world to SimulationThread::savePath before the next tick
+};
+
+struct SimStats {
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> dropped{0};    // published but overwritten before the renderer saw them
+};
+
+// Runs the World on its own thread and publishes render snapshots through a
+// lock-free triple buffer. In RealTime mode it ticks at TICK_RATE and
+// publishes after every batch; in Uncapped mode it ticks as fast as it can
+// and only builds a snapshot once the renderer has taken the previous one.
+class Checkpointer;
+class InputRecorder;
+class InputReplay;
+
+class SimulationThread
+{
+public:
+    explicit SimulationThread(World& world);
+    ~SimulationThread();
+
+    void start();
+    void stop();
+
+    void setSpeed(SimSpeed s) { speed.store(s, std::memory_order_relaxed); }
+
+    SimInput input;
+    SimStats stats;
+    std::string savePath = "world.sand";   // set before start()
+    Checkpointer* checkpointer = nullptr;  // optional autosave, set before start()
+    InputRecorder* recorder = nullptr;     // optional log of every tick's input, set before start()
+    InputReplay* replay = nullptr;         // optional: take the input from a log instead, set before start()
+    TripleBuffer<RenderSnapshot> snapshots;
+
+private:
+    void run();
+    void runTick();
+    void publishSnapshot();
+
+    World& world;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<SimSpeed> speed;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Per-instance data streamed to the GPU. Positions are grid cells, the vertex
+// shader does the grid -> NDC conversion. Material and shade share the third
+// component so the whole instance is a single uvec3 attribute (6 bytes).
+struct InstanceData {
+    uint16_t gx, gy;
+    uint16_t materialShade; // low byte = material, high byte = shade
+
+    InstanceData() : gx(0), gy(0), materialShade(0) {}
+    InstanceData(int x, int y, uint8_t material, uint8_t shade)
+        : gx((uint16_t)x), gy((uint16_t)y), materialShade((uint16_t)(material | (shade << 8))) {}
+};
+static_assert(sizeof(InstanceData) == 6, "InstanceData must stay tightly packed");
+
+// A maximal rectangle of settled cells of one material, produced by the
+// greedy mesher. Drawn with the same shader as particles; the first three
+// components line up with InstanceData and the size is a second attribute.
+struct QuadData {
+    uint16_t gx, gy;        // bottom-left cell
+    uint16_t material;      // shade byte left 0, settled cells are shaded per cell in the shader
+    uint8_t w, h;           // size in cells, at most one chunk
+
+    QuadData() : gx(0), gy(0), material(0), w(0), h(0) {}
+    QuadData(int x, int y, int width, int height, uint8_t mat)
+        : gx((uint16_t)x), gy((uint16_t)y), material(mat), w((uint8_t)width), h((uint8_t)height) {}
+};
+static_assert(sizeof(QuadData) == 8, "QuadData must stay tightly packed");
+
+// Settled-cell mesh of one chunk. Immutable once built: the world swaps in a
+// new mesh with a new version when the chunk changes, so snapshots can share
+// meshes and the renderer only re-uploads chunks whose version it hasn't seen.
+struct ChunkMesh {
+    uint64_t version = 0;    // unique across all meshes, 0 = never built
+    std::vector<QuadData> quads;
+};
+
+// LOD pyramid of one chunk (see lod.h): every level of the chunk's tile back
+// to back. Immutable and versioned like ChunkMesh.
+struct ChunkLod {
+    uint64_t version = 0;
+    std::vector<uint8_t> texels;
+};
+
+// Everything the renderer needs to draw one simulation state. Snapshots are
+// filled by the simulation thread and treated as immutable once published.
+//
+// Two layers:
+//   static   settled cells, one shared ChunkMesh per chunk (nullptr = empty).
+//            Publishing only copies pointers, so its cost doesn't grow with
+//            the size of the pile.
+//   dynamic  moving particles as instances, rebuilt every snapshot. Bucketed
+//            by chunk (row-major chunk index): the instances of chunk i are
+//            [chunkOffsets[i], chunkOffsets[i + 1]), so a horizontal run of
+//            chunks is one contiguous range, which is what culling uploads.
+//
+// When zoomed out far enough that cells are smaller than pixels, the
+// renderer asks for the LOD pyramid instead (lodChunks is empty otherwise).
+struct RenderSnapshot {
+    uint64_t tick = 0;
+    int gridWidth = 0;
+    int gridHeight = 0;
+    int chunkSize = 0;
+    int chunksX = 0;
+    int chunksY = 0;
+    std::vector<InstanceData> instances;
+    std::vector<uint32_t> chunkOffsets;   // chunksX * chunksY + 1 entries
+    std::vector<std::shared_ptr<const ChunkMesh>> staticChunks;   // chunksX * chunksY entries
+    int lodLevels = 0;
+    std::vector<std::shared_ptr<const ChunkLod>> lodChunks;       // chunksX * chunksY entries, or none
+};
+
+#endif
@@ -0,0 +1,240 @@
+#include "terrain.h"
+#include "image_io.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+// ====================== World Import ======================
+// The pass over the cells works on eight at a time in 64-bit lanes (Byte
+// Lanes in simulation.h), like byteRun in world_io.cpp: one load covers
+// eight cells' materials, and the per-cell facts the world keeps as bits
+// (occupancy, cells that could move) come out as one bit per lane.
+
+// Whether cell x differs from any of its eight neighbours (the border
+// counts as more of the same); below and above are the row itself at the
+// bottom and top edge
+static uint64_t differsAt(const uint8_t* below, const uint8_t* row, const uint8_t* above, int x, int width) {
+    int l = std::max(x - 1, 0), r = std::min(x + 1, width - 1);
+    uint8_t c = row[x];
+    return (row[l] != c) | (row[r] != c) | (below[l] != c) | (below[x] != c) | (below[r] != c) |
+           (above[l] != c) | (above[x] != c) | (above[r] != c);
+}
+
+// differsAt for a whole row, bit x % 64 of out[x / 64]
+static void differingCells(const uint8_t* below, const uint8_t* row, const uint8_t* above, int width, uint64_t* out) {
+    std::memset(out, 0, (size_t)(width + 63) / 64 * sizeof(uint64_t));
+    int x = 0;
+    // Eight-lane groups start on multiples of eight so none straddles two
+    // words; the first group and the tail need the bounds checks
+    for (; x < std::min(8, width); x++)
+        out[0] |= differsAt(below, row, above, x, width) << x;
+    for (; x + 9 <= width; x += 8) {
+        uint64_t c = load8(row + x);
+        uint64_t d = (c ^ load8(row + x - 1)) | (c ^ load8(row + x + 1)) |
+                     (c ^ load8(below + x - 1)) | (c ^ load8(below + x)) | (c ^ load8(below + x + 1)) |
+                     (c ^ load8(above + x - 1)) | (c ^ load8(above + x)) | (c ^ load8(above + x + 1));
+        out[x >> 6] |= packLanes(nonZeroLanes(d)) << (x & 63);
+    }
+    for (; x < width; x++)
+        out[x >> 6] |= differsAt(below, row, above, x, width) << (x & 63);
+}
+
+void World::importCells(int width, int height, const uint8_t* materials) {
+    static_assert(CHUNK_SIZE == 64, "a chunk row is exactly one occupancy word");
+    static_assert(CELL_SETTLED == 1, "settled flags are written as the non-empty lanes");
+    World imported(width, height, 0);
+    imported.gen = gen;
+    imported.tickCount = tickCount;
+    imported.engineUsesParticles = engineUsesParticles;
+    const int w = imported.gridWidth, h = imported.gridHeight, cx = imported.chunksX();
+
+    uint8_t isSource[256] = {}, ages[256] = {}, canMove[256] = {};
+    for (int m = 0; m < MAT_COUNT; m++) {
+        isSource[m] = MATERIALS[m].heat > 0;
+        ages[m] = MATERIALS[m].lifeMax != 0;
+        canMove[m] = MATERIALS[m].behavior != Behavior::Solid && MATERIALS[m].behavior != Behavior::None;
+    }
+
+    // Every occupied cell starts at rest in the grid. With a particle engine,
+    // cells that could move (anything but solids next to a cell that isn't
+    // the same material) wake as particles, as if setEngine had woken them;
+    // a lake or a dune only wakes its surface, and what can't move settles
+    // again on its first update. Chunks stay blank where the rows crossing
+    // them are empty.
+    std::vector<uint64_t> differing(cx);
+    uint8_t settledRow[CHUNK_SIZE];
+    for (int y = 0; y < h; y++) {
+        const uint8_t* row = materials + (size_t)y * w;
+        if (engineUsesParticles)
+            differingCells(y > 0 ? row - w : row, row, y + 1 < h ? row + w : row, w, differing.data());
+
+        for (int c = 0; c < cx; c++) {
+            int x0 = c * CHUNK_SIZE, n = std::min(CHUNK_SIZE, w - x0);
+            uint64_t occupied = 0;
+            uint32_t sources = 0;
+            uint8_t ageing = 0;
+            for (int i = 0; i < n; i += 8) {
+                int lanes = std::min(8, n - i);
+                const uint8_t* cell = row + x0 + i;
+                uint64_t v = 0;
+                std::memcpy(&v, cell, lanes);
+                uint64_t full = nonZeroLanes(v);
+                occupied |= packLanes(full) << i;
+                uint64_t settled = full >> 7;
+                std::memcpy(settledRow + i, &settled, lanes);
+                // Terrain is mostly long runs: one lookup for eight equal cells
+                if (lanes == 8 && v == 0x0101010101010101ull * cell[0]) {
+                    sources += 8 * isSource[cell[0]];
+                    ageing |= ages[cell[0]];
+                } else {
+                    for (int k = 0; k < lanes; k++) {
+                        sources += isSource[cell[k]];
+                        ageing |= ages[cell[k]];
+                    }
+                }
+            }
+            if (!occupied)
+                continue;
+            size_t chunk = (size_t)(y / CHUNK_SIZE) * cx + c;
+            OwnedChunk& owned = imported.ownChunk(chunk);
+            uint8_t* cells = owned.planes + cellOffset(x0, y);
+            uint8_t* flags = cells + CHUNK_CELLS;
+            std::memcpy(cells, row + x0, n);
+            std::memcpy(flags, settledRow, n);
+            owned.occupancy[y & (CHUNK_SIZE - 1)] = occupied | (n < 64 ? ~0ull << n : 0);
+            imported.heatSources[chunk] += sources;
+            if (ageing) {
+                for (int x = x0; x < x0 + n; x++)
+                    if (ages[row[x]])
+                        imported.startLifetime(x, y, row[x]);
+            }
+
+            if (!engineUsesParticles)
+                continue;
+            uint64_t wake = differing[c] & occupied;
+            for (int x = x0; wake; x++, wake >>= 1) {
+                if (!(wake & 1) || !canMove[row[x]] || imported.particles.size() >= MAX_PARTICLES)
+                    continue;
+                flags[x - x0] = 0;
+                // shade 0 keeps the per-cell hash colour of the settled cells around it
+                imported.particles.emplace_back(x, y, row[x], 0);
+            }
+        }
+    }
+
+    std::fill(imported.meshDirty.begin(), imported.meshDirty.end(), 1);
+    std::fill(imported.checkpointDirty.begin(), imported.checkpointDirty.end(), 1);
+    imported.setEngine(std::move(activeEngine));
+    *this = std::move(imported);
+}
+
+// ====================== Palettes ======================
+TerrainPalette defaultTerrainPalette() {
+    TerrainPalette palette;
+    palette.entries.push_back({ 0, 0, 0, MAT_EMPTY });
+    for (int m = 1; m < MAT_COUNT; m++) {
+        const MaterialInfo& info = MATERIALS[m];
+        palette.entries.push_back({ (uint8_t)(info.r * 255.0f + 0.5f), (uint8_t)(info.g * 255.0f + 0.5f),
+                                    (uint8_t)(info.b * 255.0f + 0.5f), (uint8_t)m });
+    }
+    return palette;
+}
+
+bool loadTerrainPalette(const std::string& path, TerrainPalette& palette) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open palette " << path << "\n";
+        return false;
+    }
+    TerrainPalette loaded;
+    std::string line;
+    for (int lineNumber = 1; std::getline(in, line); lineNumber++) {
+        line = line.substr(0, line.find(';'));
+        std::istringstream fields(line);
+        std::string colour, name;
+        if (!(fields >> colour))
+            continue;
+        if (colour[0] == '#')
+            colour = colour.substr(1);
+        char* end = nullptr;
+        unsigned long rgb = std::strtoul(colour.c_str(), &end, 16);
+        Material material = MAT_COUNT;
+        if (fields >> name)
+            material = name == "empty" ? MAT_EMPTY : materialByName(name.c_str());
+        if (colour.size() != 6 || *end != '\0' || material == MAT_COUNT) {
+            std::cerr << "Bad palette entry in " << path << " line " << lineNumber << ": " << line << "\n";
+            return false;
+        }
+        loaded.entries.push_back({ (uint8_t)(rgb >> 16), (uint8_t)(rgb >> 8), (uint8_t)rgb, (uint8_t)material });
+    }
+    if (loaded.entries.empty()) {
+        std::cerr << "Palette " << path << " has no entries\n";
+        return false;
+    }
+    palette = std::move(loaded);
+    return true;
+}
+
+// ====================== Image Mapping ======================
+static int colourIndex(int r, int g, int b) {
+    return (r >> 2) << 12 | (g >> 2) << 6 | (b >> 2);
+}
+
+void mapToMaterials(const TerrainPalette& palette, const unsigned char* rgba, int width, int height,
+                    std::vector<uint8_t>& materials) {
+    // Nearest entry to the centre of each table cell, then the palette's own
+    // colours exactly, in case two of them share a cell
+    std::vector<uint8_t> table(1 << 18);
+    for (int i = 0; i < (int)table.size(); i++) {
+        int r = (i >> 12) << 2 | 2, g = ((i >> 6) & 63) << 2 | 2, b = (i & 63) << 2 | 2;
+        int best = 0, bestDistance = 1 << 30;
+        for (size_t e = 0; e < palette.entries.size(); e++) {
+            const TerrainPalette::Entry& entry = palette.entries[e];
+            int dr = r - entry.r, dg = g - entry.g, db = b - entry.b;
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = (int)e;
+            }
+        }
+        table[i] = palette.entries[best].material;
+    }
+    for (const auto& entry : palette.entries)
+        table[colourIndex(entry.r, entry.g, entry.b)] = entry.material;
+
+    materials.resize((size_t)width * height);
+    for (int y = 0; y < height; y++) {
+        const unsigned char* in = rgba + (size_t)(height - 1 - y) * width * 4;
+        uint8_t* out = &materials[(size_t)y * width];
+        for (int x = 0; x < width; x++) {
+            const unsigned char* p = in + 4 * x;
+            uint8_t m = table[colourIndex(p[0], p[1], p[2])];
+            out[x] = p[3] >= 128 ? m : (uint8_t)MAT_EMPTY;
+        }
+    }
+}
+
+bool importTerrain(World& world, const std::string& path, const TerrainPalette& palette) {
+    int width, height;
+    std::vector<unsigned char> rgba;
+    if (!readImage(path, width, height, rgba))
+        return false;
+    if (width > MAX_GRID_SIZE || height > MAX_GRID_SIZE) {
+        std::cerr << "Failed to import " << path << ": larger than " << MAX_GRID_SIZE << " cells per side\n";
+        return false;
+    }
+    try {
+        std::vector<uint8_t> materials;
+        mapToMaterials(palette, rgba.data(), width, height, materials);
+        world.importCells(width, height, materials.data());
+    } catch (const std::bad_alloc&) {
+        std::cerr << "Failed to import " << path << ": out of memory for a " << width << "x" << height << " world\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "simulation.h"
+
+// ====================== Terrain Import ======================
+// Start a world from an image instead of painting it: one cell per pixel,
+// each pixel's colour turned into the nearest material of a palette.
+// Pixels less than half opaque are empty.
+struct TerrainPalette {
+    struct Entry {
+        uint8_t r, g, b;
+        uint8_t material;
+    };
+    std::vector<Entry> entries;
+};
+
+// Black for empty, and every material's base colour
+TerrainPalette defaultTerrainPalette();
+
+// Palette file: one "RRGGBB material" per line (hex colour, the # is
+// optional), blank lines and anything after ; ignored. Prints the reason
+// and returns false on failure.
+bool loadTerrainPalette(const std::string& path, TerrainPalette& palette);
+
+// Material per pixel of a width x height RGBA image (top row first), as
+// World::importCells takes them (bottom row first). Colours go through a
+// 64-levels-per-channel lookup table built once from the palette, so the
+// pass over the pixels is one load and a select each.
+void mapToMaterials(const TerrainPalette& palette, const unsigned char* rgba, int width, int height,
+                    std::vector<uint8_t>& materials);
+
+// Read the image at path (PNG or PPM, see image_io.h) and replace the
+// world's contents with it, size included. Prints the reason and returns
+// false on failure, leaving the world unchanged.
+bool importTerrain(World& world, const std::string& path, const TerrainPalette& palette);
+
+#endif
@@ -1,9 +1,21 @@
 // test fragment shader 
 #version 330 core
-in vec3 vertexColor;
+in vec2 vGridPos;
+flat in float vShade;
+flat in uint vMaterial;
 out vec4 FragColor;
 
+uniform vec3 palette[16];  // base colour per material id (MATERIALS table)
+
+// stable per-cell pseudo-random shade for cells drawn as part of a merged quad
+float cellHash(vec2 cell)
+{
+    return fract(sin(dot(cell, vec2(12.9898, 78.233))) * 43758.5453);
+}
+
 void main()
 {
-    FragColor = vec4(vertexColor, 1.0);
+    // Material colour, darkened slightly by the shade
+    float shade = vShade >= 0.0 ? vShade : cellHash(floor(vGridPos));
+    FragColor = vec4(palette[vMaterial] * (0.85 + 0.15 * shade), 1.0);
 }
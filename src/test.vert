@@ -2,28 +2,28 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;       // base square vertex
-layout (location = 1) in vec2 aSpawnPos;  // particle current position (not spawn position)
-layout (location = 2) in float aSpawnTime; // time when particle spawned
+layout (location = 1) in uvec3 aCell;     // grid x, grid y, material | (shade << 8)
+layout (location = 2) in uvec2 aSize;     // size in cells: 1x1 for particles, w x h for merged quads
 
-out vec3 vertexColor;
+out vec2 vGridPos;
+flat out float vShade;
+flat out uint vMaterial;
 
-uniform float size;        // size of each particle
-uniform float fallspeed;   // falling speed (not used anymore - physics handled in CPU)
-uniform float time;        // global time
-uniform float cellWidth;   // width of one grid cell
-uniform float cellHeight;  // height of one grid cell
+uniform mat3 viewProj;     // grid -> NDC (camera zoom/pan)
 
 void main()
 {
-    // Use the current particle position directly (no physics calculation here)
-    vec3 pos = aPos * size + vec3(aSpawnPos, 0.0);
+    // Rectangle centre in grid units, unit square scaled to the rectangle
+    vec2 size = vec2(aSize);
+    vec2 center = vec2(aCell.xy) + size * 0.5;
+    vec2 cell = center + aPos.xy * size;
+    vec3 pos = viewProj * vec3(cell, 1.0);
     
-    gl_Position = vec4(pos, 1.0);
+    gl_Position = vec4(pos.xy, 0.0, 1.0);
 
-    // Color based on particle position
-    vertexColor = vec3(
-        aSpawnPos.x * 0.5 + 0.5, 
-        aSpawnPos.y * 0.5 + 0.5, 
-        0.5
-    );
-}
\ No newline at end of file
+    // Merged quads carry no per-particle shade (0); the fragment shader shades them per cell
+    vGridPos = cell;
+    vMaterial = aCell.z & 0xFFu;
+    uint shade = aCell.z >> 8u;
+    vShade = shade == 0u ? -1.0 : float(shade) / 255.0;
+}
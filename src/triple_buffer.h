@@ -0,0 +1,62 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer / single-consumer triple buffer.
+//
+// The writer always owns one slot, the reader owns another and the third
+// ("middle") slot is exchanged atomically. publish() hands the finished write
+// slot to the middle and takes back whatever was there; acquire() swaps the
+// middle slot in only if it holds something newer than what the reader has.
+// Neither side ever waits on the other.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : middle(1), writeIndex(0), readIndex(2) {}
+
+    // slot the producer fills before calling publish()
+    T& writeBuffer() { return buffers[writeIndex]; }
+
+    // Make the write slot visible to the reader. Returns true if the previous
+    // published slot was never acquired, i.e. a snapshot got dropped.
+    bool publish()
+    {
+        uint8_t prev = middle.exchange(writeIndex | FRESH_BIT, std::memory_order_acq_rel);
+        writeIndex = prev & INDEX_MASK;
+        return (prev & FRESH_BIT) != 0;
+    }
+
+    // Swap in the newest published slot. Returns false (and keeps the current
+    // read slot) if nothing new was published since the last acquire.
+    bool acquire()
+    {
+        if ((middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0)
+            return false;
+        uint8_t prev = middle.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = prev & INDEX_MASK;
+        return true;
+    }
+
+    // true while the last published slot has not been acquired yet
+    bool pending() const
+    {
+        return (middle.load(std::memory_order_relaxed) & FRESH_BIT) != 0;
+    }
+
+    // slot the consumer reads; stable until the next acquire()
+    const T& readBuffer() const { return buffers[readIndex]; }
+
+private:
+    static const uint8_t INDEX_MASK = 0x3;
+    static const uint8_t FRESH_BIT  = 0x4;
+
+    T buffers[3];
+    alignas(64) std::atomic<uint8_t> middle;
+    alignas(64) uint8_t writeIndex;   // producer side only
+    alignas(64) uint8_t readIndex;    // consumer side only
+};
+
+#endif
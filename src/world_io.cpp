@@ -0,0 +1,553 @@
+#include "simulation.h"
+#include "paged_world.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+// ====================== World Files ======================
+// Versioned binary snapshot of everything a World needs to carry on exactly
+// where it left off. Native byte order (little-endian on every platform we
+// build for), all integers fixed width:
+//
+//   header     "SANDWRLD", u32 version, u32 width, u32 height, u64 tick,
+//              f32 spawn accumulator, u32 flags (WORLD_FILE_*)
+//   rng        u32 length + mt19937 state as the standard library prints it
+//   materials  u32 count + one NUL-terminated name per saved material id, so
+//              files survive the material table being reordered or extended
+//   planes     material, flags, lifetime: per row a u32 run count, then runs
+//              of {u16 length, u8 value}
+//   particles  u32 count + raw Particle structs
+//   heat       per heat row a u32 run count, then runs of {u16 length, f32};
+//              then per heat region a u8 of awake (bit 0) and hot (bit 1)
+//
+// Rows are run-length encoded on their own, so loading writes each run
+// straight into the world's arrays with a memset and rebuilds the derived
+// bookkeeping (occupancy bits, per-chunk counts) once per run, not per cell.
+static const char WORLD_FILE_MAGIC[8] = { 'S', 'A', 'N', 'D', 'W', 'R', 'L', 'D' };
+const uint32_t WORLD_FILE_VERSION = 1;
+const uint32_t WORLD_FILE_PARTICLES = 1 << 0;   // saved under an engine with a particle list
+const uint32_t WORLD_FILE_STALE = 1 << 1;       // particle list still holds expired cells
+
+static_assert(sizeof(Particle) == 20, "Particle layout is part of the world file format");
+static_assert(MAX_GRID_SIZE <= 65535, "a whole row must fit one u16 run");
+
+// ------------------- Encoding -------------------
+struct FileWriter {
+    std::vector<uint8_t> bytes;
+
+    void put(const void* data, size_t size) {
+        const uint8_t* p = (const uint8_t*)data;
+        bytes.insert(bytes.end(), p, p + size);
+    }
+    template <typename T> void put(T value) { put(&value, sizeof(T)); }
+};
+
+struct FileReader {
+    const uint8_t* pos;
+    const uint8_t* end;
+
+    bool get(void* data, size_t size) {
+        if ((size_t)(end - pos) < size)
+            return false;
+        std::memcpy(data, pos, size);
+        pos += size;
+        return true;
+    }
+    template <typename T> bool get(T& value) { return get(&value, sizeof(T)); }
+};
+
+// Length of the run of equal bytes starting at p, at most count. Compares
+// eight bytes at a time, so long runs (empty sky, solid ground) cost one
+// load per eight cells.
+static int byteRun(const uint8_t* p, int count) {
+    uint64_t pattern = 0x0101010101010101ull * p[0];
+    int n = 1;
+    while (n + 8 <= count) {
+        uint64_t word;
+        std::memcpy(&word, p + n, 8);
+        if (word != pattern)
+            break;
+        n += 8;
+    }
+    while (n < count && p[n] == p[0])
+        n++;
+    return n;
+}
+
+static void writeByteRow(FileWriter& out, const uint8_t* row, int width) {
+    size_t countAt = out.bytes.size();
+    out.put<uint32_t>(0);
+    uint32_t runs = 0;
+    for (int x = 0; x < width; runs++) {
+        int n = byteRun(row + x, width - x);
+        out.put<uint16_t>((uint16_t)n);
+        out.put<uint8_t>(row[x]);
+        x += n;
+    }
+    std::memcpy(&out.bytes[countAt], &runs, sizeof(runs));
+}
+
+static void writeFloatRow(FileWriter& out, const float* row, int width) {
+    size_t countAt = out.bytes.size();
+    out.put<uint32_t>(0);
+    uint32_t runs = 0;
+    for (int x = 0; x < width; runs++) {
+        int n = 1;
+        while (x + n < width && std::memcmp(&row[x + n], &row[x], sizeof(float)) == 0)
+            n++;
+        out.put<uint16_t>((uint16_t)n);
+        out.put<float>(row[x]);
+        x += n;
+    }
+    std::memcpy(&out.bytes[countAt], &runs, sizeof(runs));
+}
+
+// Decode one row of a byte plane, calling onRun(x, length, value) for every
+// run after checking it fits the row exactly
+template <typename F>
+static bool readByteRow(FileReader& in, int width, F onRun) {
+    uint32_t runs;
+    if (!in.get(runs))
+        return false;
+    int x = 0;
+    for (uint32_t i = 0; i < runs; i++) {
+        uint16_t n;
+        uint8_t value;
+        if (!in.get(n) || !in.get(value) || n == 0 || n > width - x)
+            return false;
+        onRun(x, (int)n, value);
+        x += n;
+    }
+    return x == width;
+}
+
+static bool readFloatRow(FileReader& in, float* row, int width) {
+    uint32_t runs;
+    if (!in.get(runs))
+        return false;
+    int x = 0;
+    for (uint32_t i = 0; i < runs; i++) {
+        uint16_t n;
+        float value;
+        if (!in.get(n) || !in.get(value) || n == 0 || n > width - x)
+            return false;
+        std::fill(row + x, row + x + n, value);
+        x += n;
+    }
+    return x == width;
+}
+
+// Our id for a saved material name, MAT_COUNT if we don't know it
+static Material materialFromFile(const std::string& name) {
+    return name == MATERIALS[MAT_EMPTY].name ? MAT_EMPTY : materialByName(name.c_str());
+}
+
+static void writeRandomState(FileWriter& out, const std::mt19937& gen) {
+    std::ostringstream rng;
+    rng << gen;
+    std::string state = rng.str();
+    out.put<uint32_t>((uint32_t)state.size());
+    out.put(state.data(), state.size());
+}
+
+static bool readRandomState(FileReader& in, std::mt19937& gen) {
+    uint32_t size;
+    if (!in.get(size) || size > (size_t)(in.end - in.pos))
+        return false;
+    std::istringstream state(std::string((const char*)in.pos, size));
+    in.pos += size;
+    return (bool)(state >> gen);
+}
+
+// Particle list, with saved material ids translated through remap
+static bool readParticles(FileReader& in, std::vector<Particle>& particles, int width, int height,
+                          const uint8_t* remap, uint32_t materialCount) {
+    uint32_t count;
+    if (!in.get(count) || count > MAX_PARTICLES)
+        return false;
+    particles.resize(count);
+    if (!in.get(particles.data(), count * sizeof(Particle)))
+        return false;
+    for (Particle& p : particles) {
+        if (p.x < 0 || p.x >= width || p.y < 0 || p.y >= height || p.material >= materialCount)
+            return false;
+        p.material = remap[p.material];
+        p.unused = 0;
+    }
+    return true;
+}
+
+static bool isPagedPath(const std::string& path) {
+    size_t n = std::strlen(PAGED_WORLD_EXTENSION);
+    return path.size() >= n && path.compare(path.size() - n, n, PAGED_WORLD_EXTENSION) == 0;
+}
+
+// ------------------- Save -------------------
+bool World::save(const std::string& path) const {
+    if (isPagedPath(path))
+        return savePaged(path);
+
+    FileWriter out;
+    out.bytes.reserve((size_t)gridWidth * gridHeight / 4 + particles.size() * sizeof(Particle) + 4096);
+
+    out.put(WORLD_FILE_MAGIC, sizeof(WORLD_FILE_MAGIC));
+    out.put<uint32_t>(WORLD_FILE_VERSION);
+    out.put<uint32_t>((uint32_t)gridWidth);
+    out.put<uint32_t>((uint32_t)gridHeight);
+    out.put<uint64_t>(tickCount);
+    out.put<float>(spawnAccumulator);
+    out.put<uint32_t>((engineUsesParticles ? WORLD_FILE_PARTICLES : 0) | (staleParticles ? WORLD_FILE_STALE : 0));
+
+    writeRandomState(out, gen);
+
+    out.put<uint32_t>((uint32_t)MAT_COUNT);
+    for (int m = 0; m < MAT_COUNT; m++)
+        out.put(MATERIALS[m].name, std::strlen(MATERIALS[m].name) + 1);
+
+    std::vector<uint8_t> row(gridWidth);
+    for (int plane = 0; plane < 3; plane++) {
+        for (int y = 0; y < gridHeight; y++) {
+            copyRow(y, 0, gridWidth, row.data(), plane);
+            writeByteRow(out, row.data(), gridWidth);
+        }
+    }
+
+    out.put<uint32_t>((uint32_t)particles.size());
+    out.put(particles.data(), particles.size() * sizeof(Particle));
+
+    std::vector<float> heatRow(heat.width());
+    for (int y = 0; y < heat.height(); y++) {
+        heat.readRow(y, heatRow.data());
+        writeFloatRow(out, heatRow.data(), heat.width());
+    }
+    for (size_t r = 0; r < heat.regionCount(); r++)
+        out.put<uint8_t>((uint8_t)(heat.regionAwake(r) | heat.regionHot(r) << 1));
+
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to open " << path << " for writing\n";
+        return false;
+    }
+    bool ok = std::fwrite(out.bytes.data(), 1, out.bytes.size(), file) == out.bytes.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok)
+        std::cerr << "Failed to write " << path << "\n";
+    return ok;
+}
+
+// ------------------- Load -------------------
+bool World::load(const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Failed to open " << path << "\n";
+        return false;
+    }
+    char sniff[8];
+    if (std::fread(sniff, 1, sizeof(sniff), file) == sizeof(sniff) && isPagedWorldMagic(sniff)) {
+        std::fclose(file);
+        return loadPaged(path);
+    }
+    std::vector<uint8_t> bytes;
+    if (std::fseek(file, 0, SEEK_END) == 0) {
+        long size = std::ftell(file);
+        if (size > 0) {
+            bytes.resize((size_t)size);
+            std::fseek(file, 0, SEEK_SET);
+            if (std::fread(bytes.data(), 1, bytes.size(), file) != bytes.size())
+                bytes.clear();
+        }
+    }
+    std::fclose(file);
+
+    auto fail = [&](const char* why) {
+        std::cerr << "Failed to load " << path << ": " << why << "\n";
+        return false;
+    };
+    FileReader in{ bytes.data(), bytes.data() + bytes.size() };
+
+    char magic[sizeof(WORLD_FILE_MAGIC)];
+    uint32_t version, width, height, fileFlags;
+    uint64_t tick;
+    float accumulator;
+    if (!in.get(magic, sizeof(magic)) || std::memcmp(magic, WORLD_FILE_MAGIC, sizeof(magic)) != 0)
+        return fail("not a world file");
+    if (!in.get(version) || version != WORLD_FILE_VERSION)
+        return fail("unsupported version");
+    if (!in.get(width) || !in.get(height) || !in.get(tick) || !in.get(accumulator) || !in.get(fileFlags))
+        return fail("truncated header");
+    if (width < 1 || height < 1 || width > (uint32_t)MAX_GRID_SIZE || height > (uint32_t)MAX_GRID_SIZE)
+        return fail("bad world size");
+
+    std::mt19937 rng;
+    if (!readRandomState(in, rng))
+        return fail("bad random state");
+
+    // Saved material id -> ours, by name
+    uint32_t materialCount;
+    if (!in.get(materialCount) || materialCount > 256)
+        return fail("bad material table");
+    uint8_t remap[256] = {};
+    for (uint32_t m = 0; m < materialCount; m++) {
+        const uint8_t* nul = (const uint8_t*)std::memchr(in.pos, 0, in.end - in.pos);
+        if (!nul)
+            return fail("bad material table");
+        std::string name((const char*)in.pos, (const char*)nul);
+        in.pos = nul + 1;
+        Material ours = materialFromFile(name);
+        if (ours == MAT_COUNT)
+            return fail(("unknown material " + name).c_str());
+        remap[m] = (uint8_t)ours;
+    }
+
+    // Fill a fresh world of the saved size and only swap it in once the
+    // whole file has been read, so a bad file leaves this world as it was
+    World loaded((int)width, (int)height, 0);
+    loaded.tickCount = tick;
+    loaded.spawnAccumulator = accumulator;
+    loaded.gen = rng;
+    if (!loaded.readCells(in, remap, materialCount))
+        return fail("bad cell data");
+
+    if (!readParticles(in, loaded.particles, loaded.gridWidth, loaded.gridHeight, remap, materialCount))
+        return fail("bad particle list");
+    loaded.staleParticles = (fileFlags & WORLD_FILE_STALE) != 0;
+
+    std::vector<float> heatRow(loaded.heat.width());
+    for (int y = 0; y < loaded.heat.height(); y++) {
+        if (!readFloatRow(in, heatRow.data(), loaded.heat.width()))
+            return fail("bad heat field");
+        loaded.heat.writeRow(y, heatRow.data());
+    }
+    for (size_t r = 0; r < loaded.heat.regionCount(); r++) {
+        uint8_t region;
+        if (!in.get(region))
+            return fail("truncated heat field");
+        loaded.heat.setRegion(r, (region & 1) != 0, (region & 2) != 0);
+    }
+
+    // Keep our engine; if the file was saved under one of the other kind,
+    // setEngine() hands the cells over as it would when switching
+    loaded.engineUsesParticles = (fileFlags & WORLD_FILE_PARTICLES) != 0;
+    loaded.setEngine(std::move(activeEngine));
+    // Nothing of the new contents is in any checkpoint yet
+    std::fill(loaded.checkpointDirty.begin(), loaded.checkpointDirty.end(), 1);
+    *this = std::move(loaded);
+    return true;
+}
+
+// The three cell planes, a row at a time: each row is decoded run by run
+// and handed to the chunks it crosses, of which only the ones it isn't
+// empty in get storage. The per-chunk heat source / ageing counts are added
+// per run.
+bool World::readCells(FileReader& in, const uint8_t* remap, uint32_t materialCount) {
+    auto eachChunk = [&](size_t chunkRow, int x, int n, std::vector<uint32_t>& counts) {
+        while (n > 0) {
+            int span = std::min(n, CHUNK_SIZE - x % CHUNK_SIZE);
+            counts[chunkRow + x / CHUNK_SIZE] += (uint32_t)span;
+            x += span;
+            n -= span;
+        }
+    };
+    std::vector<uint8_t> row(gridWidth);
+    auto store = [&](int y, int plane) {
+        for (int x = 0; x < gridWidth; x += CHUNK_SIZE) {
+            int span = std::min(CHUNK_SIZE, gridWidth - x);
+            size_t chunk = chunkIndex(x, y);
+            if (!ownedChunks[chunk] && row[x] == 0 && byteRun(&row[x], span) == span)
+                continue;
+            OwnedChunk& owned = ownChunk(chunk);
+            uint8_t* dst = owned.planes + plane * CHUNK_CELLS + cellOffset(x, y);
+            std::memcpy(dst, &row[x], span);
+            if (plane == 0)
+                owned.occupancy[y & (CHUNK_SIZE - 1)] |= rowOccupancy(dst);
+        }
+    };
+
+    bool valid = true;
+    for (int y = 0; y < gridHeight && valid; y++) {
+        size_t chunkRow = (size_t)(y / CHUNK_SIZE) * chunksX();
+        valid = readByteRow(in, gridWidth, [&](int x, int n, uint8_t value) {
+            if (value >= materialCount) {
+                valid = false;
+                return;
+            }
+            uint8_t material = remap[value];
+            std::memset(&row[x], material, n);
+            if (MATERIALS[material].heat > 0)
+                eachChunk(chunkRow, x, n, heatSources);
+        }) && valid;
+        if (valid)
+            store(y, 0);
+    }
+    for (int y = 0; y < gridHeight && valid; y++) {
+        valid = readByteRow(in, gridWidth, [&](int x, int n, uint8_t value) {
+            std::memset(&row[x], value, n);
+        });
+        if (valid)
+            store(y, 1);
+    }
+    for (int y = 0; y < gridHeight && valid; y++) {
+        size_t chunkRow = (size_t)(y / CHUNK_SIZE) * chunksX();
+        valid = readByteRow(in, gridWidth, [&](int x, int n, uint8_t value) {
+            std::memset(&row[x], value, n);
+            if (value)
+                eachChunk(chunkRow, x, n, agingCells);
+        });
+        if (valid)
+            store(y, 2);
+    }
+    std::fill(meshDirty.begin(), meshDirty.end(), 1);
+    return valid;
+}
+
+// ------------------- Paged Files -------------------
+// Chunk in the paged file layout (paged_world.h), which is the world's own
+// chunk layout; out holds chunkBytes. Returns whether it needs storing,
+// checked on the copy, which is contiguous and still in cache.
+bool World::copyChunk(size_t chunk, uint8_t* out) const {
+    const int hs = CHUNK_SIZE / HEAT_SCALE;
+    const size_t planeBytes = 3 * (size_t)CHUNK_CELLS;
+    std::memcpy(out, chunkData(chunk), planeBytes);
+    std::memcpy(out + planeBytes, heat.region(chunk), hs * hs * sizeof(float));
+    return !blankChunk(out);
+}
+
+// Whether a chunk in the paged file layout is the same as in a fresh world
+// (no cell, flag, lifetime or temperature differs), so it needn't be stored
+bool World::blankChunk(const uint8_t* data) {
+    const int hs = CHUNK_SIZE / HEAT_SCALE;
+    const size_t planeBytes = 3 * (size_t)CHUNK_CELLS;
+    uint8_t any = 0;
+    for (size_t i = 0; i < planeBytes; i++)
+        any |= data[i];
+    const float* heatData = (const float*)(data + planeBytes);
+    int warm = 0;
+    for (int i = 0; i < hs * hs; i++)
+        warm |= heatData[i] != AMBIENT_TEMPERATURE;
+    return !any && !warm;
+}
+
+// World fields of a paged file header, the chunk table entries but for the
+// offsets (heat region flags and counts per chunk) and the extra section:
+// everything a paged file holds besides the chunks
+void World::pagedState(PagedWorldHeader& header, std::vector<PagedChunkEntry>& chunkInfo, std::vector<uint8_t>& extra) const {
+    static_assert(MAT_COUNT <= PAGED_WORLD_MATERIALS, "paged world header holds a fixed number of materials");
+    static_assert(CHUNK_CELLS <= 65535, "per-chunk counts are stored as u16");
+    std::memset(&header, 0, sizeof(header));
+    header.flags = (engineUsesParticles ? WORLD_FILE_PARTICLES : 0) | (staleParticles ? WORLD_FILE_STALE : 0);
+    header.tick = tickCount;
+    header.spawnAccumulator = spawnAccumulator;
+    header.materialCount = MAT_COUNT;
+    for (int m = 0; m < MAT_COUNT; m++)
+        std::strncpy(header.materials[m], MATERIALS[m].name, PAGED_WORLD_NAME - 1);
+
+    chunkInfo.resize(heat.regionCount());
+    for (size_t c = 0; c < chunkInfo.size(); c++) {
+        PagedChunkEntry& entry = chunkInfo[c];
+        std::memset(&entry, 0, sizeof(entry));
+        entry.heatAwake = heat.regionAwake(c);
+        entry.heatHot = heat.regionHot(c);
+        entry.heatSources = (uint16_t)heatSources[c];
+        entry.agingCells = (uint16_t)agingCells[c];
+    }
+
+    FileWriter out;
+    out.bytes.swap(extra);
+    out.bytes.clear();
+    writeRandomState(out, gen);
+    out.put<uint32_t>((uint32_t)particles.size());
+    out.put(particles.data(), particles.size() * sizeof(Particle));
+    extra.swap(out.bytes);
+}
+
+bool World::savePaged(const std::string& path) const {
+    PagedWorldWriter writer;
+    if (!writer.create(path, gridWidth, gridHeight, CHUNK_SIZE, HEAT_SCALE))
+        return false;
+    std::vector<uint8_t> buffer(pagedChunkBytes(CHUNK_SIZE, HEAT_SCALE));
+    bool ok = true;
+    for (size_t chunk = 0; chunk < chunkMeshes.size() && ok; chunk++)
+        if (copyChunk(chunk, buffer.data()))
+            ok = writer.writeChunk(chunk, buffer.data());
+    PagedWorldHeader header;
+    std::vector<PagedChunkEntry> chunkInfo;
+    std::vector<uint8_t> extra;
+    pagedState(header, chunkInfo, extra);
+    ok = ok && writer.finish(header, chunkInfo.data(), extra);
+    if (!ok)
+        std::cerr << "Failed to write " << path << "\n";
+    return ok;
+}
+
+// Opening reads the header, chunk table and extra section only. The file
+// stays mapped as the world's pagedSource and every stored chunk is left
+// to be paged in on its first read (see World::pageIn), its heat region
+// read from the mapping until it changes; the table carries the counts the
+// world keeps per chunk, so nothing else has to be looked at up front.
+bool World::loadPaged(const std::string& path) {
+    std::unique_ptr<PagedSource> source(new PagedSource);
+    PagedWorldFile& file = source->file;
+    if (!file.open(path))
+        return false;
+    auto fail = [&](const char* why) {
+        std::cerr << "Failed to load " << path << ": " << why << "\n";
+        return false;
+    };
+    const PagedWorldHeader& h = file.header();
+    if (h.width > (uint32_t)MAX_GRID_SIZE || h.height > (uint32_t)MAX_GRID_SIZE)
+        return fail("bad world size");
+    if (h.chunkSize != (uint32_t)CHUNK_SIZE || h.heatScale != (uint32_t)HEAT_SCALE)
+        return fail("saved with a different chunk layout");
+
+    std::memset(source->remap, 0, sizeof(source->remap));
+    source->materialCount = h.materialCount;
+    source->identity = h.materialCount == (uint32_t)MAT_COUNT;
+    for (uint32_t m = 0; m < h.materialCount; m++) {
+        std::string name(h.materials[m], strnlen(h.materials[m], PAGED_WORLD_NAME));
+        Material ours = materialFromFile(name);
+        if (ours == MAT_COUNT)
+            return fail(("unknown material " + name).c_str());
+        source->remap[m] = (uint8_t)ours;
+        source->identity = source->identity && ours == (Material)m;
+    }
+
+    World loaded((int)h.width, (int)h.height, 0);
+    loaded.tickCount = h.tick;
+    loaded.spawnAccumulator = h.spawnAccumulator;
+    FileReader in{ file.extra(), file.extra() + h.extraBytes };
+    if (!readRandomState(in, loaded.gen))
+        return fail("bad random state");
+    if (!readParticles(in, loaded.particles, loaded.gridWidth, loaded.gridHeight, source->remap, h.materialCount))
+        return fail("bad particle list");
+    loaded.staleParticles = (h.flags & WORLD_FILE_STALE) != 0;
+
+    for (int cy = 0; cy < file.chunksY(); cy++) {
+        for (int cx = 0; cx < file.chunksX(); cx++) {
+            size_t chunk = (size_t)cy * file.chunksX() + cx;
+            const PagedChunkEntry& entry = file.entry(cx, cy);
+            loaded.heat.setRegion(chunk, entry.heatAwake != 0, entry.heatHot != 0);
+            if (!entry.offset) {
+                if (entry.heatSources || entry.agingCells)
+                    return fail("bad chunk table");
+                continue;
+            }
+            if (entry.heatSources > CHUNK_CELLS || entry.agingCells > CHUNK_CELLS)
+                return fail("bad chunk table");
+            loaded.chunkPlanes[chunk] = nullptr;
+            loaded.heatSources[chunk] = entry.heatSources;
+            loaded.agingCells[chunk] = entry.agingCells;
+            loaded.heat.attachRegion(chunk, file.chunkHeat(cx, cy));
+            loaded.meshDirty[chunk] = 1;
+        }
+    }
+    loaded.pagedSource = std::move(source);
+
+    loaded.engineUsesParticles = (h.flags & WORLD_FILE_PARTICLES) != 0;
+    loaded.setEngine(std::move(activeEngine));
+    // Nothing of the new contents is in any checkpoint yet
+    std::fill(loaded.checkpointDirty.begin(), loaded.checkpointDirty.end(), 1);
+    *this = std::move(loaded);
+    return true;
+}
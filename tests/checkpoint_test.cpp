@@ -0,0 +1,156 @@
+#include "test_util.h"
+
+#include "paged_world.h"
+#include "simulation.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static void pour(World& world, int t, const uint8_t* materials, int count) {
+    for (int k = 0; k < count; k++)
+        world.spawnNear(world.width() * (k + 1) / (count + 1) + t % 30 - 15, world.height() - 5, materials[(k + t / 150) % count]);
+}
+
+// Take checkpoints while the world keeps changing and write them into one
+// paged file the way Checkpointer does. Each must load as exactly the world
+// at the tick it fixed, though the world has moved on while the chunks
+// left were copied (on write, where they changed).
+static void consistentCheckpoints(World& world, const uint8_t* materials, int count, bool expectBounded) {
+    const std::string path = scratchPath("checkpoint_test.sandpage");
+    const std::string statePath = scratchPath("checkpoint_expected.sand");
+    PagedWorldWriter writer;
+    std::unique_ptr<CheckpointCapture> capture(new CheckpointCapture());
+    size_t copiedOnWrite = 0;
+    int t = 0;
+    for (int checkpoint = 0; checkpoint < 4; checkpoint++) {
+        for (int i = 0; i < 40; i++, t++) {
+            pour(world, t, materials, count);
+            world.step();
+        }
+        world.beginCheckpoint(std::move(capture), checkpoint == 0);
+        std::map<uint64_t, std::vector<uint8_t>> states;
+        while (!capture) {
+            pour(world, t++, materials, count);
+            world.step();
+            states[world.tick()] = savedBytes(world, statePath);
+            capture = world.continueCheckpoint(CHECKPOINT_CHUNKS_PER_TICK);
+        }
+        CHECK(!world.capturingCheckpoint());
+        copiedOnWrite += capture->copiedOnWrite;
+        if (expectBounded)
+            CHECK(capture->frozenChunks <= (size_t)CHECKPOINT_FINAL_CHUNKS);
+
+        if (checkpoint == 0)
+            CHECK(writer.create(path, capture->width, capture->height, CHUNK_SIZE, HEAT_SCALE));
+        for (size_t i = 0; i < capture->chunks.size(); i++)
+            CHECK(writer.writeChunk(capture->chunks[i],
+                                    capture->blank[i] ? nullptr : capture->data[capture->slots[i]].data()));
+        CHECK(writer.finish(capture->header, capture->chunkInfo.data(), capture->extra));
+
+        World restored(8, 8, 1);
+        CHECK(restored.load(path));
+        CHECK(restored.tick() == capture->header.tick && states.count(restored.tick()));
+        CHECK(savedBytes(restored, scratchPath("checkpoint_restored.sand")) == states[restored.tick()]);
+    }
+    // The fire and lava keep changing chunks the last ticks still need
+    if (!expectBounded)
+        CHECK(copiedOnWrite > 0);
+}
+
+// Capture the world as it is now, without stepping it
+static std::unique_ptr<CheckpointCapture> captureNow(World& world, std::unique_ptr<CheckpointCapture> capture) {
+    world.beginCheckpoint(std::move(capture), true);
+    while (!capture)
+        capture = world.continueCheckpoint(CHECKPOINT_CHUNKS_PER_TICK);
+    return capture;
+}
+
+static void writeCapture(PagedWorldWriter& writer, const CheckpointCapture& capture, bool finish) {
+    for (size_t i = 0; i < capture.chunks.size(); i++)
+        CHECK(writer.writeChunk(capture.chunks[i], capture.blank[i] ? nullptr : capture.data[capture.slots[i]].data()));
+    if (finish)
+        CHECK(writer.finish(capture.header, capture.chunkInfo.data(), capture.extra));
+}
+
+// An update cut short never costs the last good checkpoint: a new file
+// that was never finished leaves the old one untouched, and a damaged
+// newest header falls back to the update before it
+static void interruptedUpdates() {
+    const std::string path = scratchPath("interrupted.sandpage");
+    const std::string expectedPath = scratchPath("interrupted_expected.sand");
+    const std::string restoredPath = scratchPath("interrupted_restored.sand");
+    const uint8_t materials[] = { MAT_SAND, MAT_WATER };
+    World world(300, 200, 5);
+    int t = 0;
+    auto run = [&](int ticks) {
+        for (int i = 0; i < ticks; i++, t++) {
+            pour(world, t, materials, 2);
+            world.step();
+        }
+    };
+    auto loadsAs = [&](const std::vector<uint8_t>& expected) {
+        World restored(8, 8, 1);
+        return restored.load(path) && savedBytes(restored, restoredPath) == expected;
+    };
+
+    run(60);
+    CHECK(world.save(path));
+    std::vector<uint8_t> saved = readBytes(path), first = savedBytes(world, expectedPath);
+    run(20);
+    PagedWorldWriter writer;
+    std::unique_ptr<CheckpointCapture> capture = captureNow(world, std::unique_ptr<CheckpointCapture>(new CheckpointCapture()));
+    CHECK(writer.create(path, capture->width, capture->height, CHUNK_SIZE, HEAT_SCALE));
+    writeCapture(writer, *capture, false);
+    writer.close();
+    CHECK(readBytes(path) == saved);
+    CHECK(!std::filesystem::exists(path + ".tmp"));
+    CHECK(loadsAs(first));
+
+    // Two updates into the same file; the second goes to the other header
+    // slot and to space the first doesn't use
+    CHECK(writer.create(path, capture->width, capture->height, CHUNK_SIZE, HEAT_SCALE));
+    writeCapture(writer, *capture, true);
+    std::vector<uint8_t> second = savedBytes(world, expectedPath);
+    run(20);
+    capture = captureNow(world, std::move(capture));
+    writeCapture(writer, *capture, true);
+    writer.close();
+    CHECK(loadsAs(savedBytes(world, expectedPath)));
+
+    std::vector<uint8_t> bytes = readBytes(path);
+    bytes[PAGED_WORLD_HEADER_SLOT + offsetof(PagedWorldHeader, tick)] ^= 1;
+    writeBytes(path, bytes);
+    CHECK(loadsAs(second));
+
+    std::ostringstream rejections;
+    std::streambuf* stderrBuffer = std::cerr.rdbuf();
+    std::cerr.rdbuf(rejections.rdbuf());
+    bytes[offsetof(PagedWorldHeader, tick)] ^= 1;
+    writeBytes(path, bytes);
+    World restored(8, 8, 1);
+    CHECK(!restored.load(path));
+    std::cerr.rdbuf(stderrBuffer);
+}
+
+int main() {
+    // Only a few chunks change per tick: every checkpoint fixes its tick
+    // within the final copy bound
+    World sandbox(1600, 640, 3);
+    const uint8_t sand[] = { MAT_SAND, MAT_WATER };
+    consistentCheckpoints(sandbox, sand, 2, true);
+
+    // Burning and hot chunks change every tick; checkpoints still come out
+    // consistent when they fix their tick on the deadline
+    World furnace(1000, 500, 4);
+    const uint8_t hot[] = { MAT_WOOD, MAT_FIRE, MAT_LAVA, MAT_WATER, MAT_OIL };
+    consistentCheckpoints(furnace, hot, 5, false);
+
+    interruptedUpdates();
+    return testResult();
+}
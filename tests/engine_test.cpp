@@ -0,0 +1,111 @@
+#include "test_util.h"
+
+#include "engine.h"
+#include "simulation.h"
+
+#include <algorithm>
+
+static int countMaterial(const World& world, uint8_t material) {
+    int n = 0;
+    for (int y = 0; y < world.height(); y++)
+        for (int x = 0; x < world.width(); x++)
+            n += world.cellAt(x, y) == material;
+    return n;
+}
+
+// Worlds too small for a block row on some ticks (or any tick) must step
+// without touching cells outside the grid, and keep what they hold
+static void tinyWorlds(const char* engineName) {
+    const int sizes[][2] = { { 40, 1 }, { 40, 2 }, { 40, 3 }, { 1, 1 }, { 1, 5 }, { 2, 2 }, { 3, 2 }, { 65, 1 } };
+    for (const auto& size : sizes) {
+        World world(size[0], size[1], 7);
+        world.setEngine(EngineRegistry::instance().create(engineName));
+        int placed = 0;
+        for (int x = 0; x < size[0]; x += 2)
+            placed += world.spawnNear(x, size[1] - 1, MAT_SAND);
+        for (int t = 0; t < 40; t++)
+            world.step();
+        CHECK(countMaterial(world, MAT_SAND) == placed);
+        CHECK(world.tick() == 40);
+        // Two rows are enough for everything to land
+        if (size[0] == 40 && size[1] == 2) {
+            int landed = 0;
+            for (int x = 0; x < size[0]; x++)
+                landed += world.cellAt(x, 0) == MAT_SAND;
+            CHECK(landed == placed);
+        }
+    }
+}
+
+// Liquid poured on a floor, and gas released under a ceiling, spread into
+// a level layer and come to rest instead of wandering along its surface
+static void fluidsComeToRest() {
+    for (uint8_t material : { MAT_WATER, MAT_OIL, MAT_GAS }) {
+        bool rises = MATERIALS[material].behavior == Behavior::Gas;
+        World world(200, 100, 7);
+        for (int t = 0; t < 6000; t++) {
+            if (t < 1500)
+                world.applyInput(true, 100, rises ? 10 : 90, material);
+            world.step();
+        }
+        CHECK(world.movingCount() == 0);
+        int lowest = world.height(), highest = 0;
+        for (int x = 0; x < world.width(); x++) {
+            int depth = 0;
+            for (int y = 0; y < world.height(); y++)
+                depth += world.cellAt(x, y) == material;
+            lowest = std::min(lowest, depth);
+            highest = std::max(highest, depth);
+        }
+        CHECK(highest > 0 && highest - lowest <= 1);
+    }
+}
+
+// The block automaton lifts gases to the ceiling, lets cells in either edge
+// column through every block row, and runs the reaction table on the
+// blocks it moves: water poured onto lava turns to stone and steam
+static void margolusGasesAndReactions() {
+    World world(61, 40, 5);
+    world.setEngine(EngineRegistry::instance().create("margolus"));
+    for (int t = 0; t < 60; t++) {
+        world.applyInput(true, 30, 5, MAT_SMOKE);
+        world.step();
+    }
+    int smoke = countMaterial(world, MAT_SMOKE);
+    CHECK(smoke > 0);
+    for (int t = 0; t < 40; t++)
+        world.step();
+    int high = 0;
+    for (int y = 30; y < world.height(); y++)
+        for (int x = 0; x < world.width(); x++)
+            high += world.cellAt(x, y) == MAT_SMOKE;
+    CHECK(high == countMaterial(world, MAT_SMOKE) && high > 0);
+
+    for (int width : { 60, 61 }) {
+        World edges(width, 40, 5);
+        edges.setEngine(EngineRegistry::instance().create("margolus"));
+        CHECK(edges.spawnNear(0, 30, MAT_SAND) && edges.spawnNear(width - 1, 30, MAT_SAND));
+        for (int t = 0; t < 100; t++)
+            edges.step();
+        CHECK(edges.cellAt(0, 0) == MAT_SAND && edges.cellAt(width - 1, 0) == MAT_SAND);
+    }
+
+    World pool(80, 60, 5);
+    pool.setEngine(EngineRegistry::instance().create("margolus"));
+    for (int t = 0; t < 600; t++) {
+        if (t < 200)
+            pool.applyInput(true, 40, 50, MAT_LAVA);
+        else if (t < 400)
+            pool.applyInput(true, 40, 50, MAT_WATER);
+        pool.step();
+    }
+    CHECK(countMaterial(pool, MAT_STONE) > 0);
+}
+
+int main() {
+    tinyWorlds("margolus");
+    tinyWorlds("particles");
+    fluidsComeToRest();
+    margolusGasesAndReactions();
+    return testResult();
+}
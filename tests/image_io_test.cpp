@@ -0,0 +1,313 @@
+#include "test_util.h"
+
+#include "image_io.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <png.h>
+#include <zlib.h>
+
+// The largest single allocation, so tests can tell a rejected header from
+// one that got its size allocated first. GCC takes the free in operator
+// delete for a mismatch once both are inlined.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static size_t largestAllocation = 0;
+
+void* operator new(size_t size) {
+    largestAllocation = std::max(largestAllocation, size);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// ====================== PNG Writer ======================
+// Test images are written with libpng: any colour type, bit depth and
+// interlacing, every row filter allowed, stored or fully compressed, and
+// the image data cut into many IDAT chunks
+struct PngWriter {
+    png_structp png;
+    png_infop info;
+    std::vector<uint8_t> bytes;
+
+    PngWriter(int width, int height, int depth, int colorType, bool interlaced) {
+        png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        info = png_create_info_struct(png);
+        png_set_write_fn(png, &bytes, append, nullptr);
+        png_set_IHDR(png, info, (png_uint_32)width, (png_uint_32)height, depth, colorType,
+                     interlaced ? PNG_INTERLACE_ADAM7 : PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                     PNG_FILTER_TYPE_DEFAULT);
+    }
+    ~PngWriter() {
+        png_destroy_write_struct(&png, &info);
+    }
+
+    static void append(png_structp png, png_bytep data, size_t length) {
+        std::vector<uint8_t>* out = (std::vector<uint8_t>*)png_get_io_ptr(png);
+        out->insert(out->end(), data, data + length);
+    }
+};
+
+struct TestImage {
+    int width, height, colorType, depth;
+    bool interlaced;
+    std::vector<uint16_t> samples;      // channels per pixel, top row first
+    std::vector<uint8_t> palette;       // RGB per entry
+    std::vector<uint8_t> paletteAlpha;  // tRNS, may be shorter than the palette
+    bool hasKey = false;
+    uint16_t key[3] = {};
+
+    int channels() const {
+        static const int channelCount[7] = { 1, 0, 3, 1, 2, 0, 4 };
+        return channelCount[colorType];
+    }
+};
+
+static TestImage randomImage(std::mt19937& rng, int width, int height, int colorType, int depth, bool interlaced) {
+    TestImage image{ width, height, colorType, depth, interlaced, {}, {}, {} };
+    int channels = image.channels();
+    uint32_t limit = 1u << depth;
+    if (colorType == 3) {
+        limit = 1 + rng() % std::min(limit, 256u);
+        for (uint32_t i = 0; i < limit * 3; i++)
+            image.palette.push_back((uint8_t)rng());
+        if (rng() % 2)
+            for (uint32_t i = 0, n = 1 + rng() % limit; i < n; i++)
+                image.paletteAlpha.push_back((uint8_t)rng());
+    }
+    // Runs of repeated pixels among noise, so filters and matches both matter
+    for (int i = 0; i < width * height; i++) {
+        for (int c = 0; c < channels; c++) {
+            bool repeat = i > 0 && rng() % 3 == 0;
+            image.samples.push_back(repeat ? image.samples[(i - 1) * channels + c] : (uint16_t)(rng() % limit));
+        }
+    }
+    if ((colorType == 0 || colorType == 2) && rng() % 2) {
+        image.hasKey = true;
+        int pixel = (int)(rng() % (width * height));
+        for (int c = 0; c < channels; c++)
+            image.key[c] = image.samples[pixel * channels + c];
+    }
+    return image;
+}
+
+static std::vector<uint8_t> encodePNG(const TestImage& image, bool compress) {
+    PngWriter writer(image.width, image.height, image.depth, image.colorType, image.interlaced);
+    png_structp png = writer.png;
+    png_set_filter(png, 0, PNG_ALL_FILTERS);
+    png_set_compression_level(png, compress ? 9 : 0);
+    png_set_compression_buffer_size(png, 256);
+    png_text comment = {};
+    comment.compression = PNG_TEXT_COMPRESSION_NONE;
+    comment.key = (png_charp)"Comment";
+    comment.text = (png_charp)"test";
+    png_set_text(png, writer.info, &comment, 1);
+    std::vector<png_color> palette;
+    for (size_t i = 0; i < image.palette.size(); i += 3)
+        palette.push_back({ image.palette[i], image.palette[i + 1], image.palette[i + 2] });
+    if (image.colorType == 3)
+        png_set_PLTE(png, writer.info, palette.data(), (int)palette.size());
+    if (image.colorType == 3 && !image.paletteAlpha.empty())
+        png_set_tRNS(png, writer.info, image.paletteAlpha.data(), (int)image.paletteAlpha.size(), nullptr);
+    if (image.hasKey) {
+        png_color_16 key = {};
+        key.gray = key.red = image.key[0];
+        key.green = image.key[1];
+        key.blue = image.key[2];
+        png_set_tRNS(png, writer.info, nullptr, 0, &key);
+    }
+    png_write_info(png, writer.info);
+
+    int channels = image.channels();
+    size_t rowBytes = ((size_t)image.width * channels * image.depth + 7) / 8;
+    std::vector<uint8_t> packed(rowBytes * image.height, 0);
+    std::vector<png_bytep> rows;
+    for (int y = 0; y < image.height; y++) {
+        uint8_t* row = &packed[y * rowBytes];
+        size_t bit = 0;
+        for (int x = 0; x < image.width; x++) {
+            for (int c = 0; c < channels; c++, bit += image.depth) {
+                unsigned v = image.samples[((size_t)y * image.width + x) * channels + c];
+                if (image.depth == 16) {
+                    row[bit / 8] = (uint8_t)(v >> 8);
+                    row[bit / 8 + 1] = (uint8_t)v;
+                } else {
+                    row[bit / 8] |= (uint8_t)(v << (8 - image.depth - bit % 8));
+                }
+            }
+        }
+        rows.push_back(row);
+    }
+    png_write_image(png, rows.data());
+    png_write_end(png, writer.info);
+    return writer.bytes;
+}
+
+// The image as readImage should hand it back: 8-bit RGBA, samples scaled
+// from their depth
+static std::vector<unsigned char> expectedRGBA(const TestImage& image) {
+    int channels = image.channels();
+    unsigned maxValue = (1u << image.depth) - 1;
+    auto scale = [&](unsigned v) { return (unsigned char)((v * 255 + maxValue / 2) / maxValue); };
+    std::vector<unsigned char> rgba;
+    for (size_t i = 0; i < (size_t)image.width * image.height; i++) {
+        const uint16_t* s = &image.samples[i * channels];
+        bool keyed = image.hasKey;
+        for (int c = 0; c < channels; c++)
+            keyed = keyed && s[c] == image.key[c];
+        switch (image.colorType) {
+        case 3:
+            rgba.insert(rgba.end(), &image.palette[s[0] * 3], &image.palette[s[0] * 3] + 3);
+            rgba.push_back(s[0] < image.paletteAlpha.size() ? image.paletteAlpha[s[0]] : 255);
+            break;
+        case 0:
+        case 4:
+            rgba.insert(rgba.end(), 3, scale(s[0]));
+            rgba.push_back(image.colorType == 4 ? scale(s[1]) : keyed ? 0 : 255);
+            break;
+        default:
+            for (int c = 0; c < 3; c++)
+                rgba.push_back(scale(s[c]));
+            rgba.push_back(image.colorType == 6 ? scale(s[3]) : keyed ? 0 : 255);
+            break;
+        }
+    }
+    return rgba;
+}
+
+static bool decodes(const std::vector<uint8_t>& file, const char* name, int width, int height,
+                    const std::vector<unsigned char>& expected) {
+    std::string path = scratchPath(name);
+    writeBytes(path, file);
+    int w = 0, h = 0;
+    std::vector<unsigned char> rgba;
+    return readImage(path, w, h, rgba) && w == width && h == height && rgba == expected;
+}
+
+// ====================== Tests ======================
+// Every colour type at every depth, with and without interlacing, at sizes
+// from one pixel to past an Adam7 block on both sides: 150 images
+static std::vector<std::vector<uint8_t>> generatedPNGs() {
+    const int formats[][2] = { { 0, 1 }, { 0, 2 }, { 0, 4 }, { 0, 8 }, { 0, 16 }, { 2, 8 }, { 2, 16 }, { 3, 1 },
+                               { 3, 2 }, { 3, 4 }, { 3, 8 }, { 4, 8 }, { 4, 16 }, { 6, 8 }, { 6, 16 } };
+    const int sizes[][2] = { { 1, 1 }, { 3, 5 }, { 8, 8 }, { 17, 9 }, { 33, 20 } };
+    std::mt19937 rng(2024);
+    std::vector<std::vector<uint8_t>> files;
+    int n = 0;
+    for (const auto& format : formats) {
+        for (int interlaced = 0; interlaced < 2; interlaced++) {
+            for (const auto& size : sizes) {
+                TestImage image = randomImage(rng, size[0], size[1], format[0], format[1], interlaced);
+                std::vector<uint8_t> png = encodePNG(image, n++ % 2);
+                CHECK(decodes(png, "generated.png", size[0], size[1], expectedRGBA(image)));
+                files.push_back(png);
+            }
+        }
+    }
+    CHECK(files.size() == 150);
+    return files;
+}
+
+static void ppm() {
+    std::string p6 = "P6\n# comment\n2 2\n255\n";
+    const uint8_t pixels[12] = { 255, 0, 0, 0, 255, 0, 0, 0, 255, 10, 20, 30 };
+    std::vector<uint8_t> file(p6.begin(), p6.end());
+    file.insert(file.end(), pixels, pixels + 12);
+    CHECK(decodes(file, "image.ppm", 2, 2, { 255, 0, 0, 255, 0, 255, 0, 255, 0, 0, 255, 255, 10, 20, 30, 255 }));
+
+    std::string p5 = "P5 3 1 15\n";
+    file.assign(p5.begin(), p5.end());
+    file.insert(file.end(), { 0, 5, 15 });
+    CHECK(decodes(file, "grey.ppm", 3, 1, { 0, 0, 0, 255, 85, 85, 85, 255, 255, 255, 255, 255 }));
+}
+
+// Headers claiming far more pixels than the file holds are turned down
+// before anything that size is allocated
+static void hostileHeaders() {
+    auto png = [](int width, int height, int depth, int colorType) {
+        PngWriter writer(width, height, depth, colorType, false);
+        png_write_info(writer.png, writer.info);
+        uint8_t zeros[40] = {}, data[64];
+        uLongf length = sizeof(data);
+        CHECK(compress(data, &length, zeros, sizeof(zeros)) == Z_OK);
+        png_write_chunk(writer.png, (png_const_bytep)"IDAT", data, length);
+        png_write_chunk(writer.png, (png_const_bytep)"IEND", nullptr, 0);
+        return writer.bytes;
+    };
+    auto rejected = [](const std::string& name, const std::vector<uint8_t>& file) {
+        std::string path = scratchPath(name);
+        writeBytes(path, file);
+        int w = 0, h = 0;
+        std::vector<unsigned char> rgba;
+        largestAllocation = 0;
+        bool ok = readImage(path, w, h, rgba);
+        return !ok && largestAllocation < ((size_t)1 << 20);
+    };
+    std::vector<uint8_t> huge = png(65535, 65535, 16, 6);
+    CHECK(huge.size() < 120);
+    CHECK(rejected("huge.png", huge));
+    // Within MAX_IMAGE_PIXELS, but no 40 bytes of zlib data inflate to 256 MB
+    CHECK(rejected("huge.png", png(16384, 16384, 8, 0)));
+    CHECK(rejected("huge.png", png(65536, 1, 8, 0)));
+    std::string ppmHeader = "P6 65535 65535 255\n0123456789";
+    CHECK(rejected("huge.ppm", std::vector<uint8_t>(ppmHeader.begin(), ppmHeader.end())));
+    int w = 0, h = 0;
+    std::vector<unsigned char> rgba;
+    CHECK(!readImage(scratchPath("no_such_image.png"), w, h, rgba));
+}
+
+// Every cut short file fails; damaged ones decode or fail without reading
+// out of bounds (run under a sanitizer to catch that)
+static void damagedFiles(const std::vector<std::vector<uint8_t>>& files) {
+    int w, h;
+    std::vector<unsigned char> rgba;
+    std::string path = scratchPath("damaged.png");
+    uint32_t state = 777;
+    for (size_t f = 0; f < files.size(); f += 7) {
+        const std::vector<uint8_t>& original = files[f];
+        for (size_t length = 0; length < original.size(); length += 1 + length / 64) {
+            writeBytes(path, std::vector<uint8_t>(original.begin(), original.begin() + length));
+            CHECK(!readImage(path, w, h, rgba));
+        }
+        for (int k = 0; k < 100; k++) {
+            std::vector<uint8_t> damaged = original;
+            for (int flips = 0; flips < 1 + k % 3; flips++) {
+                state = state * 1664525u + 1013904223u;
+                damaged[8 + (state >> 8) % (damaged.size() - 8)] ^= (uint8_t)(state >> 24 | 1);
+            }
+            writeBytes(path, damaged);
+            if (readImage(path, w, h, rgba))
+                CHECK(rgba.size() == (size_t)w * h * 4);
+        }
+    }
+}
+
+int main() {
+    std::vector<std::vector<uint8_t>> files = generatedPNGs();
+    ppm();
+
+    // The reader explains every rejected file on stderr
+    std::ostringstream rejections;
+    std::streambuf* stderrBuffer = std::cerr.rdbuf();
+    std::cerr.rdbuf(rejections.rdbuf());
+    hostileHeaders();
+    damagedFiles(files);
+    std::cerr.rdbuf(stderrBuffer);
+    return testResult();
+}
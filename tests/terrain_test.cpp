@@ -0,0 +1,151 @@
+#include "test_util.h"
+
+#include "engine.h"
+#include "simulation.h"
+#include "terrain.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Terrain-like grids: runs of one material (long ones for lakes and
+// dunes, short ones for noise) in every material, at widths that end
+// anywhere in an eight-cell lane and a 64-cell chunk
+static std::vector<uint8_t> randomGrid(std::mt19937& rng, int width, int height) {
+    std::vector<uint8_t> grid((size_t)width * height);
+    int longest = 1 + (int)(rng() % 200);
+    for (size_t i = 0; i < grid.size();) {
+        uint8_t material = (uint8_t)(rng() % MAT_COUNT);
+        size_t run = std::min<size_t>(1 + rng() % longest, grid.size() - i);
+        std::fill_n(&grid[i], run, material);
+        i += run;
+    }
+    return grid;
+}
+
+// The cells importCells should wake as particles, one cell at a time:
+// anything that can move with a neighbour of another material (the border
+// counting as more of the same)
+static size_t expectedParticles(const std::vector<uint8_t>& grid, int width, int height) {
+    size_t count = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t m = grid[(size_t)y * width + x];
+            Behavior behavior = MATERIALS[m].behavior;
+            if (behavior == Behavior::None || behavior == Behavior::Solid)
+                continue;
+            bool differs = false;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int nx = std::min(std::max(x + dx, 0), width - 1), ny = std::min(std::max(y + dy, 0), height - 1);
+                    differs = differs || grid[(size_t)ny * width + nx] != m;
+                }
+            }
+            count += differs;
+        }
+    }
+    return std::min<size_t>(count, MAX_PARTICLES);
+}
+
+// The eight-lane pass over 60 random grids, under both engines. Loading a
+// world file rebuilds occupancy, heat sources and the rest cell by run, so
+// an imported world and its saved and reloaded copy must step the same.
+static void laneFill() {
+    std::mt19937 rng(99);
+    const std::string importedPath = scratchPath("imported.sand"), reloadedPath = scratchPath("reloaded.sand");
+    const int widths[] = { 1, 5, 8, 9, 63, 64, 65, 130 };
+    for (int n = 0; n < 60; n++) {
+        int width = n < 8 ? widths[n] : 1 + (int)(rng() % 300);
+        int height = 1 + (int)(rng() % 150);
+        std::vector<uint8_t> grid = randomGrid(rng, width, height);
+        for (const char* engine : { "particles", "margolus" }) {
+            World imported(32, 32, (uint32_t)n);
+            imported.setEngine(EngineRegistry::instance().create(engine));
+            imported.importCells(width, height, grid.data());
+            CHECK(imported.width() == width && imported.height() == height);
+            bool same = true;
+            for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++)
+                    same = same && imported.cellAt(x, y) == grid[(size_t)y * width + x];
+            CHECK(same);
+            if (std::string(engine) == "particles")
+                CHECK(imported.movingCount() == expectedParticles(grid, width, height));
+
+            std::vector<uint8_t> saved = savedBytes(imported, importedPath);
+            World reloaded(4, 4, 1);
+            reloaded.setEngine(EngineRegistry::instance().create(engine));
+            CHECK(reloaded.load(importedPath));
+            CHECK(savedBytes(reloaded, reloadedPath) == saved);
+            for (int t = 0; t < 50; t++) {
+                imported.step();
+                reloaded.step();
+            }
+            CHECK(savedBytes(imported, importedPath) == savedBytes(reloaded, reloadedPath));
+        }
+    }
+}
+
+// Exact palette colours, colours near one entry, transparency, and the
+// image's top row landing at the top of the world
+static void paletteMapping() {
+    TerrainPalette palette = defaultTerrainPalette();
+    std::vector<unsigned char> rgba;
+    for (const auto& entry : palette.entries)
+        rgba.insert(rgba.end(), { entry.r, entry.g, entry.b, 255 });
+    int count = (int)palette.entries.size();
+    std::vector<uint8_t> materials;
+    mapToMaterials(palette, rgba.data(), count, 1, materials);
+    for (int i = 0; i < count; i++)
+        CHECK(materials[i] == palette.entries[i].material);
+
+    TerrainPalette custom;
+    custom.entries = { { 0, 0, 0, MAT_EMPTY }, { 255, 255, 255, MAT_STONE }, { 200, 160, 40, MAT_SAND } };
+    rgba = { 250, 240, 255, 255,   30, 10, 20, 255,   190, 170, 50, 255,
+             255, 255, 255, 127,   255, 255, 255, 128,   200, 160, 40, 0 };
+    mapToMaterials(custom, rgba.data(), 3, 2, materials);
+    // Bottom row first: the image's second row comes out first
+    const uint8_t expected[6] = { MAT_EMPTY, MAT_STONE, MAT_EMPTY, MAT_STONE, MAT_EMPTY, MAT_SAND };
+    CHECK(std::equal(materials.begin(), materials.end(), expected));
+}
+
+// A whole import from a file, and a failed one leaving the world as it was
+static void importFile() {
+    std::string header = "P6 2 2 255\n";
+    std::vector<uint8_t> file(header.begin(), header.end());
+    TerrainPalette palette = defaultTerrainPalette();
+    uint8_t sand[3] = {}, stone[3] = {};
+    for (const auto& entry : palette.entries) {
+        if (entry.material == MAT_SAND)
+            std::copy_n(&entry.r, 3, sand);
+        if (entry.material == MAT_STONE)
+            std::copy_n(&entry.r, 3, stone);
+    }
+    file.insert(file.end(), sand, sand + 3);
+    file.insert(file.end(), { 0, 0, 0 });
+    file.insert(file.end(), stone, stone + 3);
+    file.insert(file.end(), stone, stone + 3);
+    writeBytes(scratchPath("terrain.ppm"), file);
+
+    World world(10, 10, 3);
+    CHECK(importTerrain(world, scratchPath("terrain.ppm"), palette));
+    CHECK(world.width() == 2 && world.height() == 2);
+    CHECK(world.cellAt(0, 0) == MAT_STONE && world.cellAt(1, 0) == MAT_STONE);
+    CHECK(world.cellAt(0, 1) == MAT_SAND && world.cellAt(1, 1) == MAT_EMPTY);
+
+    std::ostringstream rejections;
+    std::streambuf* stderrBuffer = std::cerr.rdbuf();
+    std::cerr.rdbuf(rejections.rdbuf());
+    CHECK(!importTerrain(world, scratchPath("no_such_terrain.ppm"), palette));
+    std::cerr.rdbuf(stderrBuffer);
+    CHECK(world.width() == 2 && world.cellAt(0, 1) == MAT_SAND);
+}
+
+int main() {
+    laneFill();
+    paletteMapping();
+    importFile();
+    return testResult();
+}
@@ -0,0 +1,85 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "simulation.h"
+
+// ====================== Test Helpers ======================
+// Each test is a plain executable run by ctest: a failed CHECK prints where
+// it failed and carries on, main returns testResult().
+inline int& testFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                          \
+    do {                                                                                          \
+        if (!(condition)) {                                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n";       \
+            testFailures()++;                                                                     \
+        }                                                                                         \
+    } while (0)
+
+inline int testResult() {
+    if (testFailures())
+        std::cerr << testFailures() << " check(s) failed\n";
+    return testFailures() ? 1 : 0;
+}
+
+// ------------------- Scratch Files -------------------
+// Files a test writes go in a directory of its own under the system temp
+// directory, removed with everything in it when the test exits
+struct ScratchDir {
+    std::filesystem::path dir;
+
+    ScratchDir() {
+        std::random_device seed;
+        dir = std::filesystem::temp_directory_path() / ("sand_test_" + std::to_string(seed()));
+        std::filesystem::create_directories(dir);
+    }
+    ~ScratchDir() {
+        std::error_code ignored;
+        std::filesystem::remove_all(dir, ignored);
+    }
+};
+
+inline std::string scratchPath(const std::string& name) {
+    static ScratchDir scratch;
+    return (scratch.dir / name).string();
+}
+
+inline std::vector<uint8_t> readBytes(const std::string& path) {
+    std::vector<uint8_t> bytes;
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return bytes;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    std::fclose(file);
+    return bytes;
+}
+
+inline void writeBytes(const std::string& path, const std::vector<uint8_t>& bytes) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!bytes.empty())
+        std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+}
+
+// The bytes path would hold if world were saved there
+inline std::vector<uint8_t> savedBytes(const World& world, const std::string& path) {
+    CHECK(world.save(path));
+    return readBytes(path);
+}
+
+#endif
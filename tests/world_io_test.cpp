@@ -0,0 +1,124 @@
+#include "test_util.h"
+
+#include "simulation.h"
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A world with a bit of everything a file has to carry: settled and moving
+// cells, several materials, lifetimes and a warm heat field
+static World busyWorld() {
+    World world(150, 100, 11);
+    const uint8_t poured[] = { MAT_SAND, MAT_WATER, MAT_WOOD, MAT_OIL, MAT_FIRE, MAT_LAVA, MAT_STONE };
+    for (int t = 0; t < 700; t++) {
+        world.applyInput(t % 100 < 80, 20 + (t / 100) * 18, 90, poured[t / 100]);
+        world.step();
+    }
+    return world;
+}
+
+// Saved, loaded into a world of another size and saved again, the file
+// comes out the same; and both worlds carry on identically
+static void roundTrip(const World& original, const std::string& extension) {
+    World world = busyWorld();
+    std::vector<uint8_t> saved = savedBytes(original, scratchPath("round_trip_a" + extension));
+    CHECK(!saved.empty());
+
+    World loaded(10, 10, 1);
+    CHECK(loaded.load(scratchPath("round_trip_a" + extension)));
+    CHECK(loaded.width() == original.width() && loaded.height() == original.height());
+    CHECK(loaded.tick() == original.tick());
+    CHECK(loaded.movingCount() == original.movingCount());
+    CHECK(savedBytes(loaded, scratchPath("round_trip_b" + extension)) == saved);
+
+    for (int t = 0; t < 300; t++) {
+        world.step();
+        loaded.step();
+    }
+    CHECK(savedBytes(world, scratchPath("round_trip_a" + extension)) == savedBytes(loaded, scratchPath("round_trip_b" + extension)));
+}
+
+// Every prefix of a file is rejected and leaves the world as it was
+static void truncatedFiles(const World& original, const std::string& extension) {
+    std::vector<uint8_t> saved = savedBytes(original, scratchPath("truncated_source" + extension));
+    World world(30, 20, 5);
+    world.spawnNear(3, 3, MAT_STONE);
+    std::vector<uint8_t> before = savedBytes(world, scratchPath("truncated_before.sand"));
+
+    std::string path = scratchPath("truncated" + extension);
+    size_t stride = saved.size() / 500 + 1;
+    for (size_t size = 0; size < saved.size(); size += size < 512 ? 1 : stride) {
+        writeBytes(path, std::vector<uint8_t>(saved.begin(), saved.begin() + size));
+        CHECK(!world.load(path));
+    }
+    CHECK(savedBytes(world, scratchPath("truncated_after.sand")) == before);
+}
+
+// Damaged bytes anywhere either fail to load or load into a world that
+// steps safely (run under a sanitizer to catch reads out of bounds)
+static void corruptFiles(const World& original, const std::string& extension) {
+    std::vector<uint8_t> saved = savedBytes(original, scratchPath("corrupt_source" + extension));
+    std::string path = scratchPath("corrupt" + extension);
+    uint32_t state = 12345;
+    size_t stride = saved.size() / 1500 + 1;
+    for (size_t at = 0; at < saved.size(); at += at < 512 ? 1 : stride) {
+        std::vector<uint8_t> damaged = saved;
+        state = state * 1664525u + 1013904223u;
+        damaged[at] ^= (uint8_t)(state >> 24 | 1);
+        writeBytes(path, damaged);
+        World world(8, 8, 1);
+        if (world.load(path)) {
+            for (int t = 0; t < 10; t++)
+                world.step();
+        }
+    }
+}
+
+// A paged world runs from its file: chunks nothing happens around are
+// evicted once quiet for PAGE_EVICT_TICKS and read back from the file when
+// something reaches them again, and none of that shows in how it steps
+static void pagedEviction() {
+    World original(400, 100, 17);
+    for (int t = 0; t < 900; t++) {
+        original.applyInput(t < 600, t % 2 ? 30 : 350, 90, MAT_SAND);
+        original.step();
+    }
+    const std::string path = scratchPath("eviction.sandpage");
+    CHECK(original.save(path));
+    World loaded(8, 8, 1);
+    CHECK(loaded.load(path));
+    // Drawing it reads every stored chunk
+    RenderSnapshot snapshot;
+    loaded.buildSnapshot(snapshot);
+    for (int t = 0; t < PAGE_EVICT_TICKS + 400; t++) {
+        bool pouring = t >= PAGE_EVICT_TICKS + 100 && t < PAGE_EVICT_TICKS + 200;
+        original.applyInput(pouring, 350, 90, MAT_SAND);
+        loaded.applyInput(pouring, 350, 90, MAT_SAND);
+        original.step();
+        loaded.step();
+    }
+    CHECK(savedBytes(original, scratchPath("eviction_a.sand")) == savedBytes(loaded, scratchPath("eviction_b.sand")));
+}
+
+int main() {
+    World original = busyWorld();
+    CHECK(original.movingCount() > 0);
+
+    // The loaders explain every rejected file on stderr
+    std::ostringstream rejections;
+    std::streambuf* stderrBuffer = std::cerr.rdbuf();
+
+    roundTrip(original, ".sand");
+    roundTrip(original, ".sandpage");
+    pagedEviction();
+    std::cerr.rdbuf(rejections.rdbuf());
+    CHECK(!World(4, 4, 1).load(scratchPath("no_such_file.sand")));
+    truncatedFiles(original, ".sand");
+    corruptFiles(original, ".sand");
+    truncatedFiles(original, ".sandpage");
+    corruptFiles(original, ".sandpage");
+    std::cerr.rdbuf(stderrBuffer);
+    return testResult();
+}